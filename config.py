@@ -14,6 +14,9 @@ def get_doc_classes():
         "SQLiteAccess",
         "SQLiteQuery",
         "SQLiteQueryResult",
+        "SQLiteBatchResult",
+        "SQLiteCursor",
+        "SQLiteAsyncResult",
         "SQLiteDatabase",
         "SQLiteColumnSchema",
         "SQLite",
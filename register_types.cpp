@@ -36,6 +36,9 @@
 #include "src/resource_loader_sqlite.h"
 #include "src/resource_saver_sqlite.h"
 #include "src/resource_sqlite.h"
+#include "src/sqlite_file_access_vfs.h"
+#include "src/sqlite_memory.h"
+#include "src/sqlite_statistics.h"
 #include "core/io/resource_loader.h"
 #include "core/io/resource_saver.h"
 
@@ -54,8 +57,23 @@ void initialize_sqlite_module(ModuleInitializationLevel p_level) {
 	ClassDB::register_class<SQLiteAccess>();
 	ClassDB::register_class<SQLiteQuery>();
 	ClassDB::register_class<SQLiteQueryResult>();
+	ClassDB::register_class<SQLiteBatchResult>();
+	ClassDB::register_class<SQLiteCursor>();
+	ClassDB::register_class<SQLiteAsyncResult>();
 	ClassDB::register_class<SQLiteColumnSchema>();
 	ClassDB::register_class<SQLite>();
+
+	// Before the first SQLite call, the allocator cannot change afterwards.
+	if (sqlite_memory_configure() != SQLITE_OK) {
+		ERR_PRINT("Cannot initialize SQLite with Godot's allocator.");
+	}
+	if (sqlite_file_access_vfs_register() != SQLITE_OK) {
+		ERR_PRINT("Cannot register the SQLite FileAccess VFS, packed databases cannot be opened.");
+	}
+
+	// Performance is created after the server modules, register once the
+	// main loop runs.
+	callable_mp_static(&SQLiteStatistics::register_monitors).call_deferred();
 }
 
 void uninitialize_sqlite_module(ModuleInitializationLevel p_level) {
@@ -71,4 +89,7 @@ void uninitialize_sqlite_module(ModuleInitializationLevel p_level) {
 		ResourceSaver::remove_resource_format_saver(sqlite_saver);
 		sqlite_saver.unref();
 	}
+
+	sqlite_file_access_vfs_unregister();
+	sqlite_memory_shutdown();
 }
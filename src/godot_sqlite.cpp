@@ -31,55 +31,365 @@
 #include "core/config/project_settings.h"
 #include "core/core_bind.h"
 #include "core/error/error_macros.h"
+#include "core/io/file_access.h"
+#include "core/io/json.h"
 #include "core/os/os.h"
+#include "core/os/time.h"
 #include "core/variant/variant.h"
+#include "core/variant/variant_internal.h"
 #include "sqlite/sqlite3.h"
 
 #include "godot_sqlite.h"
+#include "sqlite_file_access_vfs.h"
+#include "sqlite_statistics.h"
+
+static Variant column_value(sqlite3_stmt *stmt, int i) {
+	const int column_type = sqlite3_column_type(stmt, i);
+	switch (column_type) {
+		case SQLITE_INTEGER:
+			return Variant(sqlite3_column_int64(stmt, i));
+
+		case SQLITE_FLOAT:
+			return Variant(sqlite3_column_double(stmt, i));
+
+		case SQLITE_TEXT: {
+			int size = sqlite3_column_bytes(stmt, i);
+			String str =
+					String::utf8((const char *)sqlite3_column_text(stmt, i), size);
+			return Variant(str);
+		}
+		case SQLITE_BLOB: {
+			PackedByteArray arr;
+			int size = sqlite3_column_bytes(stmt, i);
+			arr.resize(size);
+			memcpy(arr.ptrw(), sqlite3_column_blob(stmt, i), size);
+			return Variant(arr);
+		}
+		case SQLITE_NULL: {
+		} break;
+		default:
+			ERR_PRINT("This kind of data is not yet supported: " + itos(column_type));
+			break;
+	}
+	return Variant();
+}
 
-Array fast_parse_row(sqlite3_stmt *stmt) {
-	Array result;
+// Storage class a declared column type is expected to hold, following the
+// SQLite affinity rules. SQLITE_NULL when it cannot be predicted: expressions,
+// NUMERIC affinity and columns without a declared type.
+static int declared_storage_class(const char *p_decltype) {
+	if (p_decltype == nullptr) {
+		return SQLITE_NULL;
+	}
+	const String decl = String::utf8(p_decltype).to_upper();
+	if (decl.contains("INT")) {
+		return SQLITE_INTEGER;
+	}
+	if (decl.contains("CHAR") || decl.contains("CLOB") || decl.contains("TEXT")) {
+		return SQLITE_TEXT;
+	}
+	if (decl.contains("BLOB")) {
+		return SQLITE_BLOB;
+	}
+	if (decl.contains("REAL") || decl.contains("FLOA") || decl.contains("DOUB")) {
+		return SQLITE_FLOAT;
+	}
+	return SQLITE_NULL;
+}
 
-	const int column_count = sqlite3_column_count(stmt);
+static Variant::Type storage_class_type(int p_storage_class) {
+	switch (p_storage_class) {
+		case SQLITE_INTEGER:
+			return Variant::Type::INT;
+		case SQLITE_FLOAT:
+			return Variant::Type::FLOAT;
+		case SQLITE_TEXT:
+			return Variant::Type::STRING;
+		case SQLITE_BLOB:
+			return Variant::Type::PACKED_BYTE_ARRAY;
+		default:
+			return Variant::Type::NIL;
+	}
+}
+
+// Decodes a cell of a column whose storage class is known from the schema.
+// NULLs and values stored with another class take the generic path.
+template <int STORAGE>
+static Variant decode_column(sqlite3_stmt *p_stmt, int p_column) {
+	if (unlikely(sqlite3_column_type(p_stmt, p_column) != STORAGE)) {
+		return column_value(p_stmt, p_column);
+	}
+	if constexpr (STORAGE == SQLITE_INTEGER) {
+		return sqlite3_column_int64(p_stmt, p_column);
+	} else if constexpr (STORAGE == SQLITE_FLOAT) {
+		return sqlite3_column_double(p_stmt, p_column);
+	} else if constexpr (STORAGE == SQLITE_TEXT) {
+		const char *text = (const char *)sqlite3_column_text(p_stmt, p_column);
+		return String::utf8(text, sqlite3_column_bytes(p_stmt, p_column));
+	} else {
+		const void *blob = sqlite3_column_blob(p_stmt, p_column);
+		PackedByteArray arr;
+		arr.resize(sqlite3_column_bytes(p_stmt, p_column));
+		memcpy(arr.ptrw(), blob, arr.size());
+		return arr;
+	}
+}
 
+const LocalVector<SQLiteBindPlan::Decoder> &SQLiteBindPlan::get_decoders(sqlite3_stmt *p_stmt) {
+	const int column_count = sqlite3_column_count(p_stmt);
+	if (likely((int)decoders.size() == column_count)) {
+		return decoders;
+	}
+	decoders.resize(column_count);
+	storage_classes.resize(column_count);
 	for (int i = 0; i < column_count; i++) {
-		const int column_type = sqlite3_column_type(stmt, i);
-		Variant value;
-		switch (column_type) {
+		storage_classes[i] = declared_storage_class(sqlite3_column_decltype(p_stmt, i));
+		switch (storage_classes[i]) {
 			case SQLITE_INTEGER:
-				value = Variant(sqlite3_column_int(stmt, i));
+				decoders[i] = &decode_column<SQLITE_INTEGER>;
 				break;
-
 			case SQLITE_FLOAT:
-				value = Variant(sqlite3_column_double(stmt, i));
+				decoders[i] = &decode_column<SQLITE_FLOAT>;
+				break;
+			case SQLITE_TEXT:
+				decoders[i] = &decode_column<SQLITE_TEXT>;
+				break;
+			case SQLITE_BLOB:
+				decoders[i] = &decode_column<SQLITE_BLOB>;
+				break;
+			default:
+				decoders[i] = &column_value;
 				break;
+		}
+	}
+	return decoders;
+}
 
-			case SQLITE_TEXT: {
-				int size = sqlite3_column_bytes(stmt, i);
-				String str =
-						String::utf8((const char *)sqlite3_column_text(stmt, i), size);
-				value = Variant(str);
+// Reads and resets the counters of a statement, so each result only counts
+// its own run.
+static Dictionary statement_status(sqlite3_stmt *p_stmt) {
+	static const struct {
+		int op;
+		const char *name;
+	} counters[] = {
+		{ SQLITE_STMTSTATUS_FULLSCAN_STEP, "fullscan_steps" },
+		{ SQLITE_STMTSTATUS_SORT, "sorts" },
+		{ SQLITE_STMTSTATUS_AUTOINDEX, "autoindex_rows" },
+		{ SQLITE_STMTSTATUS_VM_STEP, "vm_steps" },
+		{ SQLITE_STMTSTATUS_REPREPARE, "reprepares" },
+		{ SQLITE_STMTSTATUS_RUN, "runs" },
+		{ SQLITE_STMTSTATUS_MEMUSED, "memory_used" },
+	};
+
+	Dictionary status;
+	for (const auto &counter : counters) {
+		status[counter.name] = sqlite3_stmt_status(p_stmt, counter.op, 1);
+	}
+
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+	Array loops;
+	for (int i = 0;; i++) {
+		sqlite3_int64 nloop = 0;
+		if (sqlite3_stmt_scanstatus_v2(p_stmt, i, SQLITE_SCANSTAT_NLOOP, 0, &nloop) != 0) {
+			break;
+		}
+		sqlite3_int64 nvisit = 0;
+		sqlite3_int64 ncycle = 0;
+		double estimate = 0.0;
+		const char *name = nullptr;
+		const char *explain = nullptr;
+		sqlite3_stmt_scanstatus_v2(p_stmt, i, SQLITE_SCANSTAT_NVISIT, 0, &nvisit);
+		sqlite3_stmt_scanstatus_v2(p_stmt, i, SQLITE_SCANSTAT_NCYCLE, 0, &ncycle);
+		sqlite3_stmt_scanstatus_v2(p_stmt, i, SQLITE_SCANSTAT_EST, 0, &estimate);
+		sqlite3_stmt_scanstatus_v2(p_stmt, i, SQLITE_SCANSTAT_NAME, 0, &name);
+		sqlite3_stmt_scanstatus_v2(p_stmt, i, SQLITE_SCANSTAT_EXPLAIN, 0, &explain);
+
+		Dictionary loop;
+		loop["name"] = name != nullptr ? String::utf8(name) : String();
+		loop["explain"] = explain != nullptr ? String::utf8(explain) : String();
+		loop["loops"] = nloop;
+		loop["rows_visited"] = nvisit;
+		loop["estimated_rows"] = estimate;
+		loop["cycles"] = ncycle;
+		loops.push_back(loop);
+	}
+	sqlite3_stmt_scanstatus_reset(p_stmt);
+	status["scan_status"] = loops;
+#endif
+	return status;
+}
+
+static Array decode_row(sqlite3_stmt *p_stmt, const LocalVector<SQLiteBindPlan::Decoder> &p_decoders) {
+	Array row;
+	const int column_count = p_decoders.size();
+	row.resize(column_count);
+	for (int i = 0; i < column_count; i++) {
+		row[i] = p_decoders[i](p_stmt, i);
+	}
+	return row;
+}
+
+/**
+ * Accumulates one column of a columnar result straight from sqlite3_column_*.
+ *
+ * The column is specialised to the storage class of its first non-NULL cell:
+ * INTEGER -> PackedInt64Array, REAL -> PackedFloat64Array, TEXT ->
+ * PackedStringArray and BLOB -> Array of PackedByteArray. NULL cells of a
+ * packed column read as 0, 0.0 or "". An INTEGER column that meets a REAL is
+ * widened to floats; any other mismatch demotes the column to a generic Array.
+ * A column can be seeded with the storage class of its declared type, so it
+ * is packed even if every cell is NULL.
+ */
+class ColumnBuilder {
+	int type = SQLITE_NULL;
+	bool generic = false;
+	int64_t size = 0;
+
+	PackedInt64Array ints;
+	PackedFloat64Array floats;
+	PackedStringArray strings;
+	Array values;
+
+	void push_default() {
+		switch (type) {
+			case SQLITE_INTEGER:
+				ints.push_back(0);
 				break;
-			}
-			case SQLITE_BLOB: {
-				PackedByteArray arr;
-				int size = sqlite3_column_bytes(stmt, i);
-				arr.resize(size);
-				memcpy(arr.ptrw(), sqlite3_column_blob(stmt, i), size);
-				value = Variant(arr);
+			case SQLITE_FLOAT:
+				floats.push_back(0.0);
 				break;
+			case SQLITE_TEXT:
+				strings.push_back(String());
+				break;
+			default:
+				values.push_back(Variant());
+				break;
+		}
+	}
+
+	void specialize(int p_type) {
+		type = p_type;
+		// Back-fill the leading NULL cells.
+		for (int64_t i = 0; i < size; i++) {
+			push_default();
+		}
+	}
+
+	void widen() {
+		floats.resize(ints.size());
+		const int64_t *src = ints.ptr();
+		double *dst = floats.ptrw();
+		for (int64_t i = 0; i < ints.size(); i++) {
+			dst[i] = (double)src[i];
+		}
+		ints.clear();
+		type = SQLITE_FLOAT;
+	}
+
+	void demote() {
+		if (type != SQLITE_BLOB) {
+			values.resize(size);
+			for (int64_t i = 0; i < size; i++) {
+				switch (type) {
+					case SQLITE_INTEGER:
+						values[i] = ints[i];
+						break;
+					case SQLITE_FLOAT:
+						values[i] = floats[i];
+						break;
+					case SQLITE_TEXT:
+						values[i] = strings[i];
+						break;
+					default:
+						break;
+				}
+			}
+		}
+		ints.clear();
+		floats.clear();
+		strings.clear();
+		generic = true;
+	}
+
+public:
+	void seed(int p_storage_class) {
+		if (size == 0 && !generic && p_storage_class != SQLITE_NULL) {
+			type = p_storage_class;
+		}
+	}
+
+	void append(sqlite3_stmt *p_stmt, int p_column) {
+		const int cell_type = sqlite3_column_type(p_stmt, p_column);
+
+		if (!generic && cell_type != SQLITE_NULL && cell_type != type) {
+			if (type == SQLITE_NULL) {
+				specialize(cell_type);
+			} else if (type == SQLITE_INTEGER && cell_type == SQLITE_FLOAT) {
+				widen();
+			} else if (!(type == SQLITE_FLOAT && cell_type == SQLITE_INTEGER)) {
+				demote();
+			}
+		}
+		size++;
+
+		if (generic) {
+			values.push_back(column_value(p_stmt, p_column));
+			return;
+		}
+		if (cell_type == SQLITE_NULL) {
+			if (type != SQLITE_NULL) {
+				push_default();
 			}
-			case SQLITE_NULL: {
+			return;
+		}
+		switch (type) {
+			case SQLITE_INTEGER:
+				ints.push_back(sqlite3_column_int64(p_stmt, p_column));
+				break;
+			case SQLITE_FLOAT:
+				floats.push_back(sqlite3_column_double(p_stmt, p_column));
+				break;
+			case SQLITE_TEXT: {
+				const char *text = (const char *)sqlite3_column_text(p_stmt, p_column);
+				strings.push_back(String::utf8(text, sqlite3_column_bytes(p_stmt, p_column)));
 			} break;
 			default:
-				ERR_PRINT("This kind of data is not yet supported: " + itos(column_type));
+				values.push_back(column_value(p_stmt, p_column));
 				break;
 		}
+	}
 
-		result.push_back(value);
+	Variant finish() {
+		if (generic) {
+			return values;
+		}
+		switch (type) {
+			case SQLITE_INTEGER:
+				return ints;
+			case SQLITE_FLOAT:
+				return floats;
+			case SQLITE_TEXT:
+				return strings;
+			case SQLITE_BLOB:
+				return values;
+			default: {
+				// Only NULL cells were seen.
+				Array nulls;
+				nulls.resize(size);
+				return nulls;
+			}
+		}
 	}
+};
 
-	return result;
+static PackedStringArray column_names(sqlite3_stmt *stmt) {
+	PackedStringArray names;
+	const int column_count = sqlite3_column_count(stmt);
+	names.resize(column_count);
+	for (int i = 0; i < column_count; i++) {
+		names.set(i, String::utf8(sqlite3_column_name(stmt, i)));
+	}
+	return names;
 }
 
 SQLiteQuery::SQLiteQuery() {}
@@ -101,6 +411,8 @@ String SQLiteQuery::get_last_error_message() const {
 }
 
 TypedArray<SQLiteColumnSchema> SQLiteQuery::get_columns() {
+	ERR_FAIL_NULL_V_MSG(db, Array(), "Database is undefined.");
+	MutexLock lock(db->mutex);
 	if (is_ready() == false) {
 		ERR_FAIL_COND_V(prepare() == false, Array());
 	}
@@ -108,6 +420,8 @@ TypedArray<SQLiteColumnSchema> SQLiteQuery::get_columns() {
 	// At this point stmt can't be null.
 	CRASH_COND(stmt == nullptr);
 
+	// The schema comes from the declared types, so it is known before the
+	// query runs. Expressions have no declared type and report NIL.
 	TypedArray<SQLiteColumnSchema> res;
 	const int col_count = sqlite3_column_count(stmt);
 	res.resize(col_count);
@@ -118,28 +432,25 @@ TypedArray<SQLiteColumnSchema> SQLiteQuery::get_columns() {
 		schema.instantiate();
 		// Key name
 		const char *col_name = sqlite3_column_name(stmt, i);
-		schema->set_name(String(col_name));
-		switch (sqlite3_column_type(stmt, i)) {
-			case SQLITE_INTEGER:
-				schema->set_type(Variant::Type::INT);
-				break;
-			case SQLITE_FLOAT:
-				schema->set_type(Variant::Type::FLOAT);
-				break;
-			case SQLITE_TEXT:
-				schema->set_type(Variant::Type::STRING);
-				break;
-			case SQLITE_BLOB:
-				schema->set_type(Variant::Type::PACKED_BYTE_ARRAY);
-				break;
-			case SQLITE_NULL:
-				schema->set_type(Variant::Type::NIL);
-				break;
-			default:
-				ERR_PRINT("This kind of data is not yet supported: " + itos(sqlite3_column_type(stmt, i)));
-				schema->set_type(Variant::Type::NIL);
-				break;
+		schema->set_name(String::utf8(col_name));
+		schema->set_type(storage_class_type(declared_storage_class(sqlite3_column_decltype(stmt, i))));
+
+#ifdef SQLITE_ENABLE_COLUMN_METADATA
+		const char *database_name = sqlite3_column_database_name(stmt, i);
+		const char *table_name = sqlite3_column_table_name(stmt, i);
+		const char *origin_name = sqlite3_column_origin_name(stmt, i);
+		if (table_name != nullptr && origin_name != nullptr) {
+			int not_null = 0;
+			int primary_key = 0;
+			int auto_increment = 0;
+			if (sqlite3_table_column_metadata(sqlite3_db_handle(stmt), database_name, table_name, origin_name,
+						nullptr, nullptr, &not_null, &primary_key, &auto_increment) == SQLITE_OK) {
+				schema->set_not_null(not_null != 0);
+				schema->set_primary_key(primary_key != 0);
+				schema->set_auto_increment(auto_increment != 0);
+			}
 		}
+#endif
 		res[i] = schema;
 	}
 
@@ -151,28 +462,111 @@ bool SQLiteQuery::prepare() {
 	ERR_FAIL_COND_V(db == nullptr, SQLITE_ERROR);
 	ERR_FAIL_COND_V(db->get_handler() == nullptr, SQLITE_ERROR);
 	ERR_FAIL_COND_V(query == "", SQLITE_ERROR);
-	// Prepare the statement
-	int result = sqlite3_prepare_v2(db->get_handler(), query.utf8().ptr(), -1,
-			&stmt, nullptr);
+	// Prepare the statement, or reuse an idle one with the same SQL.
+	statement_key = query.strip_edges();
+	int result = db->statement_cache.checkout(db->get_handler(), statement_key, &stmt, &bind_plan);
 
 	// Cannot prepare query!
 	ERR_FAIL_COND_V_MSG(result != SQLITE_OK, false,
 			"SQL Error: " + db->get_last_error_message());
 
+	// sqlite3_stmt_readonly() is also true for BEGIN, COMMIT, ROLLBACK,
+	// SAVEPOINT and RELEASE, which must stay on the writer. Only statements
+	// that return columns can go to the read pool.
+	read_only = stmt != nullptr && sqlite3_stmt_readonly(stmt) != 0 && sqlite3_column_count(stmt) > 0;
 	return true;
 }
 
 void SQLiteQuery::finalize() {
+	if (cursor) {
+		// The statement is going away, nothing is left to fetch.
+		cursor->done = true;
+	}
 	if (stmt) {
-		sqlite3_finalize(stmt);
+		if (db != nullptr) {
+			SQLiteWriterLock lock(db);
+			db->statement_cache.checkin(statement_key, stmt, bind_plan);
+		} else {
+			sqlite3_finalize(stmt);
+			memdelete_notnull(bind_plan);
+		}
 		stmt = nullptr;
+		bind_plan = nullptr;
+	}
+}
+
+int SQLiteStatementCache::checkout(sqlite3 *p_db, const String &p_sql, sqlite3_stmt **r_stmt, SQLiteBindPlan **r_plan) {
+	HashMap<String, List<Entry>::Element *>::Iterator E = lookup.find(p_sql);
+	if (E) {
+		hits++;
+		*r_stmt = E->value->get().stmt;
+		*r_plan = E->value->get().plan;
+		lru.erase(E->value);
+		lookup.erase(p_sql);
+		return SQLITE_OK;
+	}
+
+	misses++;
+	const CharString sql = p_sql.utf8();
+	const unsigned int flags = capacity > 0 ? SQLITE_PREPARE_PERSISTENT : 0;
+	int result = sqlite3_prepare_v3(p_db, sql.get_data(), sql.length(), flags, r_stmt, nullptr);
+	if (result != SQLITE_OK) {
+		*r_stmt = nullptr;
+	}
+	*r_plan = *r_stmt != nullptr ? memnew(SQLiteBindPlan) : nullptr;
+	return result;
+}
+
+void SQLiteStatementCache::checkin(const String &p_sql, sqlite3_stmt *p_stmt, SQLiteBindPlan *p_plan) {
+	if (capacity <= 0 || lookup.has(p_sql)) {
+		// Disabled, or another query already returned the same statement.
+		sqlite3_finalize(p_stmt);
+		memdelete_notnull(p_plan);
+		return;
+	}
+
+	sqlite3_reset(p_stmt);
+	sqlite3_clear_bindings(p_stmt);
+	if (p_plan != nullptr) {
+		p_plan->release(p_stmt);
+	}
+
+	Entry entry;
+	entry.sql = p_sql;
+	entry.stmt = p_stmt;
+	entry.plan = p_plan;
+	lookup.insert(p_sql, lru.push_front(entry));
+	evict(capacity);
+}
+
+void SQLiteStatementCache::evict(int p_max_size) {
+	while (lru.size() > p_max_size) {
+		List<Entry>::Element *oldest = lru.back();
+		lookup.erase(oldest->get().sql);
+		sqlite3_finalize(oldest->get().stmt);
+		memdelete_notnull(oldest->get().plan);
+		lru.erase(oldest);
 	}
 }
 
+void SQLiteStatementCache::clear() {
+	evict(0);
+}
+
+void SQLiteStatementCache::set_capacity(int p_capacity) {
+	capacity = MAX(p_capacity, 0);
+	evict(capacity);
+}
+
 void SQLiteQuery::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("get_last_error_message"), &SQLiteQuery::get_last_error_message);
 	ClassDB::bind_method(D_METHOD("execute", "arguments"), &SQLiteQuery::execute, DEFVAL(Array()));
+	ClassDB::bind_method(D_METHOD("execute_columnar", "arguments"), &SQLiteQuery::execute_columnar, DEFVAL(Array()));
 	ClassDB::bind_method(D_METHOD("batch_execute", "rows"), &SQLiteQuery::batch_execute);
+	ClassDB::bind_method(D_METHOD("batch_execute_transaction", "rows", "savepoint_per_row"), &SQLiteQuery::batch_execute_transaction, DEFVAL(false));
+	ClassDB::bind_method(D_METHOD("batch_execute_columns", "columns"), &SQLiteQuery::batch_execute_columns);
+	ClassDB::bind_method(D_METHOD("open_cursor", "arguments"), &SQLiteQuery::open_cursor, DEFVAL(Array()));
+	ClassDB::bind_method(D_METHOD("execute_async", "arguments"), &SQLiteQuery::execute_async, DEFVAL(Array()));
 	ClassDB::bind_method(D_METHOD("get_columns"), &SQLiteQuery::get_columns);
 	ClassDB::bind_method(D_METHOD("get_query"), &SQLiteQuery::get_query);
 	ClassDB::bind_method(D_METHOD("get_arguments"), &SQLiteQuery::get_arguments);
@@ -182,17 +576,144 @@ void SQLiteQuery::_bind_methods() {
 	ADD_PROPERTY(PropertyInfo(Variant::STRING, "query"), "", "get_query");
 }
 
+// Pragmas accepted as open options, in the order they are applied.
+// page_size goes first, it only takes effect before the file is written.
+static const struct {
+	const char *name;
+	const char *keywords; // Allowed values separated by "|", nullptr for numbers.
+	bool reader; // Also applied to the read pool connections.
+} open_pragmas[] = {
+	{ "page_size", nullptr, false },
+	{ "journal_mode", "DELETE|TRUNCATE|PERSIST|MEMORY|OFF", false },
+	{ "locking_mode", "NORMAL|EXCLUSIVE", false },
+	{ "synchronous", "OFF|NORMAL|FULL|EXTRA", false },
+	{ "cache_size", nullptr, true },
+	{ "cache_spill", nullptr, true },
+	{ "mmap_size", nullptr, true },
+};
+
+// Options read before the connection is opened, see open_flags().
+static const char *const open_flag_options[] = { "read_only", "no_mutex", "uri" };
+
+static int open_flags(const Dictionary &p_options, int p_flags) {
+	if (p_options.get("read_only", false)) {
+		p_flags = (p_flags & ~(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)) | SQLITE_OPEN_READONLY;
+	}
+	if (p_options.get("no_mutex", false)) {
+		// Only safe while one thread at a time uses the connection, so
+		// execute_async() and open_read_pool() refuse such connections.
+		p_flags |= SQLITE_OPEN_NOMUTEX;
+	}
+	if (p_options.get("uri", false)) {
+		p_flags |= SQLITE_OPEN_URI;
+	}
+	return p_flags;
+}
+
 SQLiteAccess::SQLiteAccess() {
+	SQLiteStatistics::add_connection(this);
+}
+
+bool SQLiteAccess::open_in_memory(const Dictionary &p_options) {
+	if (sqlite3_open_v2(":memory:", &db, open_flags(p_options, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE), nullptr) != SQLITE_OK) {
+		sqlite3_close_v2(db);
+		db = nullptr;
+		return false;
+	}
+	return finish_open(p_options);
+}
+
+bool SQLiteAccess::apply_options(sqlite3 *p_handle, const Dictionary &p_options, bool p_reader) {
+	const Array keys = p_options.keys();
+	for (int i = 0; i < keys.size(); i++) {
+		const String key = keys[i];
+		const Variant &value = p_options[key];
+		bool known = key == "lookaside_slot_size" || key == "lookaside_slot_count" || key == "busy_timeout";
+		bool keyword = false;
+		for (const char *flag : open_flag_options) {
+			known = known || key == flag;
+		}
+		for (const auto &pragma : open_pragmas) {
+			if (key == pragma.name) {
+				known = true;
+				keyword = pragma.keywords != nullptr;
+				ERR_FAIL_COND_V_MSG(keyword && !String(pragma.keywords).split("|").has(String(value).to_upper()), false, vformat("Open option %s must be one of %s.", key, pragma.keywords));
+			}
+		}
+		ERR_FAIL_COND_V_MSG(!known, false, "Unknown open option: " + key);
+		ERR_FAIL_COND_V_MSG(!keyword && !value.is_num() && value.get_type() != Variant::BOOL, false, "Open option must be a number or a boolean: " + key);
+	}
+
+	// Slots are allocated by SQLite. A missing value defaults to the one
+	// SQLite is built with.
+	if (p_options.has("lookaside_slot_size") || p_options.has("lookaside_slot_count")) {
+		const int slot_size = p_options.get("lookaside_slot_size", 1200);
+		const int slot_count = p_options.get("lookaside_slot_count", 40);
+		ERR_FAIL_COND_V_MSG(slot_size < 0 || slot_count < 0, false, "Lookaside slot size and count cannot be negative.");
+		const int err = sqlite3_db_config(p_handle, SQLITE_DBCONFIG_LOOKASIDE, nullptr, slot_size, slot_count);
+		ERR_FAIL_COND_V_MSG(err != SQLITE_OK, false, "Cannot configure lookaside: " + String::utf8(sqlite3_errstr(err)));
+	}
+	if (p_options.has("busy_timeout") && !p_reader) {
+		sqlite3_busy_timeout(p_handle, p_options["busy_timeout"]);
+	}
+
+	for (const auto &pragma : open_pragmas) {
+		if (!p_options.has(pragma.name) || (p_reader && !pragma.reader)) {
+			continue;
+		}
+		const Variant &value = p_options[pragma.name];
+		const String setting = pragma.keywords != nullptr ? String(value).to_upper() : itos(value);
+		const CharString sql = vformat("PRAGMA %s=%s", pragma.name, setting).utf8();
+		sqlite3_stmt *stmt = nullptr;
+		int err = sqlite3_prepare_v2(p_handle, sql.get_data(), sql.length(), &stmt, nullptr);
+		// journal_mode and locking_mode answer with the mode in effect, which
+		// differs when the database cannot use the requested one.
+		String result;
+		if (err == SQLITE_OK) {
+			err = sqlite3_step(stmt);
+			if (err == SQLITE_ROW && sqlite3_column_type(stmt, 0) == SQLITE_TEXT) {
+				result = String::utf8((const char *)sqlite3_column_text(stmt, 0)).to_upper();
+			}
+			err = err == SQLITE_ROW || err == SQLITE_DONE ? SQLITE_OK : err;
+		}
+		sqlite3_finalize(stmt);
+		ERR_FAIL_COND_V_MSG(err != SQLITE_OK, false, vformat("Cannot set %s: %s", pragma.name, String::utf8(sqlite3_errmsg(p_handle))));
+		ERR_FAIL_COND_V_MSG(!result.is_empty() && pragma.keywords != nullptr && result != setting, false, vformat("Cannot set %s to %s, the database uses %s.", pragma.name, setting, result));
+	}
+	return true;
 }
 
-bool SQLiteAccess::open_in_memory() {
-	if (sqlite3_open_v2(":memory:", &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK) {
+bool SQLiteAccess::finish_open(const Dictionary &p_options) {
+	if (!apply_options(get_handler(), p_options)) {
+		close();
 		return false;
 	}
+	open_options = p_options.duplicate();
+	apply_trace(get_handler());
+	MutexLock lock(mutex);
+	publish_autocommit();
 	return true;
 }
 
+void SQLiteAccess::publish_autocommit() {
+	sqlite3 *handle = get_handler();
+	writer_autocommit.set_to(handle != nullptr && sqlite3_get_autocommit(handle) != 0);
+}
+
+SQLiteWriterLock::SQLiteWriterLock(SQLiteAccess *p_access) :
+		access(p_access) {
+	access->mutex.lock();
+}
+
+SQLiteWriterLock::~SQLiteWriterLock() {
+	access->publish_autocommit();
+	access->mutex.unlock();
+}
+
 bool SQLiteAccess::close() {
+	SQLiteWriterLock lock(this);
+	close_read_pool();
+
 	// Finalize all queries before close the DB.
 	// Reverse order because I need to remove the not available queries.
 	for (uint32_t i = queries.size(); i > 0; i -= 1) {
@@ -206,6 +727,8 @@ bool SQLiteAccess::close() {
 		}
 	}
 
+	statement_cache.clear();
+
 	if (db) {
 		// Cannot close database!
 		int result = sqlite3_close_v2(db);
@@ -222,6 +745,163 @@ bool SQLiteAccess::close() {
 	}
 }
 
+bool SQLiteAccess::open_read_pool(int p_readers, int p_busy_timeout_msec) {
+	MutexLock lock(mutex);
+	ERR_FAIL_COND_V_MSG(p_readers <= 0, false, "The read pool needs at least one connection.");
+	ERR_FAIL_COND_V_MSG(db == nullptr || memory_read, false, "A read pool needs a database opened from a file.");
+	const char *filename = sqlite3_db_filename(db, "main");
+	ERR_FAIL_COND_V_MSG(filename == nullptr || filename[0] == '\0', false, "A read pool cannot be used with in-memory or temporary databases.");
+	sqlite3_vfs *vfs = nullptr;
+	sqlite3_file_control(db, "main", SQLITE_FCNTL_VFS_POINTER, &vfs);
+	ERR_FAIL_COND_V_MSG(vfs != nullptr && String(vfs->zName) == SQLITE_FILE_ACCESS_VFS_NAME, false, "A read pool cannot be used with packed databases.");
+	ERR_FAIL_COND_V_MSG(open_options.get("read_only", false), false, "A read pool cannot be used with a database opened read-only.");
+	ERR_FAIL_COND_V_MSG(String(open_options.get("locking_mode", "")).to_upper() == "EXCLUSIVE", false, "A read pool cannot be used with locking_mode EXCLUSIVE, the writer keeps the readers out.");
+	ERR_FAIL_COND_V_MSG(open_options.get("no_mutex", false), false, "A read pool cannot be used with no_mutex, reads would run next to the writer's other users.");
+
+	close_read_pool();
+
+	// Without WAL readers and the writer lock each other out while a write
+	// commits, so both sides wait instead of failing with SQLITE_BUSY. A
+	// busy_timeout given to open() wins over the default.
+	const int busy_timeout = open_options.get("busy_timeout", p_busy_timeout_msec);
+	sqlite3_busy_timeout(db, busy_timeout);
+
+	RWLockWrite pool_lock(read_pool_lock);
+	for (int i = 0; i < p_readers; i++) {
+		sqlite3 *handle = nullptr;
+		// Each reader is only used by the thread that checked it out.
+		if (sqlite3_open_v2(filename, &handle, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK) {
+			ERR_PRINT("Cannot open read connection: " + String::utf8(sqlite3_errmsg(handle)));
+			sqlite3_close_v2(handle);
+			continue;
+		}
+		sqlite3_busy_timeout(handle, busy_timeout);
+		if (!apply_options(handle, open_options, true)) {
+			sqlite3_close_v2(handle);
+			continue;
+		}
+		apply_trace(handle);
+
+		SQLiteReader *reader = memnew(SQLiteReader);
+		reader->handle = handle;
+		readers.push_back(reader);
+		read_pool_semaphore.post();
+	}
+	return !readers.is_empty();
+}
+
+void SQLiteAccess::close_read_pool() {
+	// Waits until no query runs on a reader.
+	RWLockWrite pool_lock(read_pool_lock);
+	for (uint32_t i = 0; i < readers.size(); i++) {
+		read_pool_semaphore.wait();
+	}
+	for (SQLiteReader *reader : readers) {
+		reader->statement_cache.clear();
+		sqlite3_close_v2(reader->handle);
+		memdelete(reader);
+	}
+	readers.clear();
+}
+
+SQLiteReader *SQLiteAccess::acquire_reader() {
+	// Callers hold read_pool_lock for reading.
+	if (readers.is_empty()) {
+		return nullptr;
+	}
+
+	read_pool_acquires.increment();
+	if (!read_pool_semaphore.try_wait()) {
+		read_pool_waits.increment();
+		const uint64_t begin = OS::get_singleton()->get_ticks_usec();
+		read_pool_semaphore.wait();
+		read_pool_wait_usec.add(OS::get_singleton()->get_ticks_usec() - begin);
+	}
+
+	MutexLock lock(read_pool_mutex);
+	for (SQLiteReader *reader : readers) {
+		if (!reader->busy) {
+			reader->busy = true;
+			return reader;
+		}
+	}
+	// The semaphore counts idle readers, this cannot happen.
+	read_pool_semaphore.post();
+	ERR_FAIL_V(nullptr);
+}
+
+void SQLiteAccess::release_reader(SQLiteReader *p_reader) {
+	{
+		MutexLock lock(read_pool_mutex);
+		p_reader->busy = false;
+	}
+	read_pool_semaphore.post();
+}
+
+int SQLiteAccess::get_read_pool_size() const {
+	RWLockRead pool_lock(read_pool_lock);
+	return readers.size();
+}
+
+Dictionary SQLiteAccess::get_read_pool_stats() const {
+	Dictionary stats;
+	int idle = 0;
+	{
+		RWLockRead pool_lock(read_pool_lock);
+		MutexLock lock(read_pool_mutex);
+		for (const SQLiteReader *reader : readers) {
+			if (!reader->busy) {
+				idle++;
+			}
+		}
+		stats["size"] = readers.size();
+	}
+	stats["idle"] = idle;
+	stats["acquires"] = read_pool_acquires.get();
+	stats["waits"] = read_pool_waits.get();
+	stats["wait_usec"] = read_pool_wait_usec.get();
+	return stats;
+}
+
+int64_t SQLiteAccess::get_buffered_memory_used() const {
+	MutexLock lock(mutex);
+	return memory_read && spmemvfs_db.mem ? spmemvfs_db.mem->used : 0;
+}
+
+int64_t SQLiteAccess::get_buffered_memory_reserved() const {
+	MutexLock lock(mutex);
+	return memory_read && spmemvfs_db.mem ? spmemvfs_db.mem->total : 0;
+}
+
+int SQLiteAccess::exec(const char *p_sql) {
+	return sqlite3_exec(get_handler(), p_sql, nullptr, nullptr, nullptr);
+}
+
+bool SQLiteAccess::begin_batch(bool &r_nested) {
+	sqlite3 *dbs = get_handler();
+	ERR_FAIL_NULL_V_MSG(dbs, false, "Cannot begin a transaction. The database was not opened.");
+
+	// Inside a user transaction a savepoint keeps the batch atomic without
+	// committing the outer transaction.
+	r_nested = sqlite3_get_autocommit(dbs) == 0;
+	return exec(r_nested ? "SAVEPOINT sqlite_batch" : "BEGIN") == SQLITE_OK;
+}
+
+bool SQLiteAccess::end_batch(bool p_nested, bool p_commit) {
+	if (p_commit) {
+		if (exec(p_nested ? "RELEASE sqlite_batch" : "COMMIT") == SQLITE_OK) {
+			return true;
+		}
+	}
+	if (p_nested) {
+		exec("ROLLBACK TO sqlite_batch");
+		exec("RELEASE sqlite_batch");
+	} else if (sqlite3_get_autocommit(get_handler()) == 0) {
+		exec("ROLLBACK");
+	}
+	return false;
+}
+
 sqlite3_stmt *SQLiteAccess::prepare(const char *query) {
 	// Get database pointer
 	sqlite3 *dbs = get_handler();
@@ -254,7 +934,7 @@ Dictionary SQLiteAccess::parse_row(sqlite3_stmt *stmt, int result_type) {
 		// Get column value
 		switch (col_type) {
 			case SQLITE_INTEGER:
-				value = Variant(sqlite3_column_int(stmt, i));
+				value = Variant(sqlite3_column_int64(stmt, i));
 				break;
 
 			case SQLITE_FLOAT:
@@ -304,6 +984,7 @@ int SQLiteAccess::get_last_error_code() const {
 }
 
 SQLiteAccess::~SQLiteAccess() {
+	SQLiteStatistics::remove_connection(this);
 	close();
 	for (uint32_t i = 0; i < queries.size(); i += 1) {
 		SQLiteQuery *query = Object::cast_to<SQLiteQuery>(queries[i]->get_ref());
@@ -314,17 +995,53 @@ SQLiteAccess::~SQLiteAccess() {
 }
 
 void SQLiteAccess::_bind_methods() {
-	ClassDB::bind_method(D_METHOD("open", "database"), &SQLiteAccess::open);
-	ClassDB::bind_method(D_METHOD("open_in_memory"), &SQLiteAccess::open_in_memory);
-	ClassDB::bind_method(D_METHOD("open_buffered", "path", "buffers", "size"), &SQLiteAccess::open_buffered);
+	ClassDB::bind_method(D_METHOD("open", "database", "options"), &SQLiteAccess::open, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("open_in_memory", "options"), &SQLiteAccess::open_in_memory, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("open_buffered", "path", "buffers", "size", "options"), &SQLiteAccess::open_buffered, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("get_lookaside_stats", "reset"), &SQLiteAccess::get_lookaside_stats, DEFVAL(false));
+	ClassDB::bind_method(D_METHOD("get_page_cache_stats", "reset"), &SQLiteAccess::get_page_cache_stats, DEFVAL(false));
 	ClassDB::bind_method(D_METHOD("backup", "path"), &SQLiteAccess::backup);
+	ClassDB::bind_method(D_METHOD("open_read_pool", "readers", "busy_timeout_msec"), &SQLiteAccess::open_read_pool, DEFVAL(5000));
+	ClassDB::bind_method(D_METHOD("close_read_pool"), &SQLiteAccess::close_read_pool);
+	ClassDB::bind_method(D_METHOD("get_read_pool_size"), &SQLiteAccess::get_read_pool_size);
+	ClassDB::bind_method(D_METHOD("get_read_pool_stats"), &SQLiteAccess::get_read_pool_stats);
+	ClassDB::bind_method(D_METHOD("get_buffered_memory_used"), &SQLiteAccess::get_buffered_memory_used);
+	ClassDB::bind_method(D_METHOD("get_buffered_memory_reserved"), &SQLiteAccess::get_buffered_memory_reserved);
 	ClassDB::bind_method(D_METHOD("get_last_error_message"), &SQLiteAccess::get_last_error_message);
 	ClassDB::bind_method(D_METHOD("get_last_error_code"), &SQLiteAccess::get_last_error_code);
 	ClassDB::bind_method(D_METHOD("close"), &SQLiteAccess::close);
 	ClassDB::bind_method(D_METHOD("create_query", "statement", "arguments"), &SQLiteAccess::create_query, DEFVAL(Array()));
+
+	ClassDB::bind_method(D_METHOD("set_statement_cache_capacity", "capacity"), &SQLiteAccess::set_statement_cache_capacity);
+	ClassDB::bind_method(D_METHOD("get_statement_cache_capacity"), &SQLiteAccess::get_statement_cache_capacity);
+	ClassDB::bind_method(D_METHOD("get_statement_cache_size"), &SQLiteAccess::get_statement_cache_size);
+	ClassDB::bind_method(D_METHOD("get_statement_cache_hits"), &SQLiteAccess::get_statement_cache_hits);
+	ClassDB::bind_method(D_METHOD("get_statement_cache_misses"), &SQLiteAccess::get_statement_cache_misses);
+	ClassDB::bind_method(D_METHOD("set_query_stats_enabled", "enabled"), &SQLiteAccess::set_query_stats_enabled);
+	ClassDB::bind_method(D_METHOD("is_query_stats_enabled"), &SQLiteAccess::is_query_stats_enabled);
+	ClassDB::bind_method(D_METHOD("get_query_stats"), &SQLiteAccess::get_query_stats);
+	ClassDB::bind_method(D_METHOD("set_statement_status_enabled", "enabled"), &SQLiteAccess::set_statement_status_enabled);
+	ClassDB::bind_method(D_METHOD("is_statement_status_enabled"), &SQLiteAccess::is_statement_status_enabled);
+	ClassDB::bind_method(D_METHOD("reset_query_stats"), &SQLiteAccess::reset_query_stats);
+	ClassDB::bind_method(D_METHOD("set_slow_query_threshold_msec", "msec"), &SQLiteAccess::set_slow_query_threshold_msec);
+	ClassDB::bind_method(D_METHOD("get_slow_query_threshold_msec"), &SQLiteAccess::get_slow_query_threshold_msec);
+	ClassDB::bind_method(D_METHOD("set_slow_query_log_size", "size"), &SQLiteAccess::set_slow_query_log_size);
+	ClassDB::bind_method(D_METHOD("get_slow_query_log_size"), &SQLiteAccess::get_slow_query_log_size);
+	ClassDB::bind_method(D_METHOD("set_slow_query_log_path", "path"), &SQLiteAccess::set_slow_query_log_path);
+	ClassDB::bind_method(D_METHOD("get_slow_query_log_path"), &SQLiteAccess::get_slow_query_log_path);
+	ClassDB::bind_method(D_METHOD("get_slow_queries"), &SQLiteAccess::get_slow_queries);
+	ClassDB::bind_method(D_METHOD("clear_slow_queries"), &SQLiteAccess::clear_slow_queries);
+	ClassDB::bind_method(D_METHOD("clear_statement_cache"), &SQLiteAccess::clear_statement_cache);
+
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "statement_cache_capacity", PROPERTY_HINT_RANGE, "0,1024,1,or_greater"), "set_statement_cache_capacity", "get_statement_cache_capacity");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "query_stats_enabled"), "set_query_stats_enabled", "is_query_stats_enabled");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "statement_status_enabled"), "set_statement_status_enabled", "is_statement_status_enabled");
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "slow_query_threshold_msec", PROPERTY_HINT_RANGE, "0,1000,0.01,or_greater,suffix:ms"), "set_slow_query_threshold_msec", "get_slow_query_threshold_msec");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "slow_query_log_size", PROPERTY_HINT_RANGE, "0,1024,1,or_greater"), "set_slow_query_log_size", "get_slow_query_log_size");
+	ADD_PROPERTY(PropertyInfo(Variant::STRING, "slow_query_log_path", PROPERTY_HINT_FILE, "*.jsonl"), "set_slow_query_log_path", "get_slow_query_log_path");
 }
 
-bool SQLiteAccess::open(const String &path) {
+bool SQLiteAccess::open(const String &path, const Dictionary &p_options) {
 	if (!path.strip_edges().length()) {
 		print_error("Path is wrong!");
 		return false;
@@ -335,106 +1052,331 @@ bool SQLiteAccess::open(const String &path) {
 		return false;
 	}
 	if (!engine_singleton->is_editor_hint() && path.begins_with("res://")) {
-		Ref<FileAccess> dbfile = FileAccess::open(path, FileAccess::READ);
-		if (dbfile.is_null()) {
+		// The journal must stay in memory, the VFS has no lock or journal files.
+		ERR_FAIL_COND_V_MSG(p_options.has("journal_mode") && String(p_options["journal_mode"]).to_upper() != "MEMORY", false, "Packed res:// databases only support journal_mode MEMORY.");
+		// Page the packed database in through FileAccess instead of copying it.
+		if (sqlite3_open_v2(path.utf8().get_data(), &db, open_flags(p_options, SQLITE_OPEN_READWRITE), SQLITE_FILE_ACCESS_VFS_NAME) != SQLITE_OK) {
 			print_error("Cannot open packed database!");
+			sqlite3_close_v2(db);
+			db = nullptr;
 			return false;
 		}
-		int64_t size = dbfile->get_length();
-		PackedByteArray buffer;
-		buffer.resize(size);
-		buffer.fill(0);
-		dbfile->get_buffer(buffer.ptrw(), size);
-		return open_buffered(path, buffer, size);
+		// Changes only live in memory, so must the journal.
+		exec("PRAGMA journal_mode=MEMORY");
+		return finish_open(p_options);
 	}
 	ProjectSettings *project_settings_singleton = ProjectSettings::get_singleton();
 	if (!project_settings_singleton) {
 		print_error("Cannot get project settings!");
-		return SQLITE_ERROR;
+		return false;
 	}
 	String real_path = project_settings_singleton->globalize_path(path.strip_edges());
 
-	return sqlite3_open(real_path.utf8().get_data(), &db);
+	if (sqlite3_open_v2(real_path.utf8().get_data(), &db, open_flags(p_options, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE), nullptr) != SQLITE_OK) {
+		print_error("Cannot open database: " + String::utf8(sqlite3_errmsg(db)));
+		sqlite3_close_v2(db);
+		db = nullptr;
+		return false;
+	}
+	return finish_open(p_options);
 }
 
-String SQLiteAccess::bind_args(sqlite3_stmt *stmt, const Array &args) {
-	int param_count = sqlite3_bind_parameter_count(stmt);
-	if (param_count != args.size()) {
-		return "SQLiteQuery failed; expected " + itos(param_count) + " arguments, got " + itos(args.size());
-	}
+/**
+ * SQLite data types:
+ * - NULL
+ * - INTEGER (signed, max 8 bytes)
+ * - REAL (stored as a double-precision float)
+ * - TEXT (stored in database encoding of UTF-8, UTF-16BE or UTF-16LE)
+ * - BLOB (1:1 storage)
+ */
+
+int SQLiteBindPlan::bind_null(SQLiteBindPlan *p_plan, sqlite3_stmt *p_stmt, int p_index, const Variant &p_value) {
+	return sqlite3_bind_null(p_stmt, p_index);
+}
 
-	/**
-	 * SQLite data types:
-	 * - NULL
-	 * - INTEGER (signed, max 8 bytes)
-	 * - REAL (stored as a double-precision float)
-	 * - TEXT (stored in database encoding of UTF-8, UTF-16BE or UTF-16LE)
-	 * - BLOB (1:1 storage)
-	 */
+int SQLiteBindPlan::bind_int(SQLiteBindPlan *p_plan, sqlite3_stmt *p_stmt, int p_index, const Variant &p_value) {
+	return sqlite3_bind_int64(p_stmt, p_index, (int64_t)p_value);
+}
 
-	for (int i = 0; i < param_count; i++) {
-		int retcode;
-		switch (args[i].get_type()) {
-			case Variant::Type::NIL:
-				retcode = sqlite3_bind_null(stmt, i + 1);
-				break;
-			case Variant::Type::BOOL:
-			case Variant::Type::INT:
-				retcode = sqlite3_bind_int(stmt, i + 1, (int)args[i]);
-				break;
-			case Variant::Type::FLOAT:
-				retcode = sqlite3_bind_double(stmt, i + 1, (double)args[i]);
-				break;
-			case Variant::Type::STRING:
-				retcode = sqlite3_bind_text(
-						stmt, i + 1, String(args[i]).utf8().get_data(), -1, SQLITE_TRANSIENT);
-				break;
-			case Variant::Type::PACKED_BYTE_ARRAY:
-				retcode =
-						sqlite3_bind_blob(stmt, i + 1, PackedByteArray(args[i]).ptr(),
-								PackedByteArray(args[i]).size(), SQLITE_TRANSIENT);
-				break;
-			default:
-				return "SQLite was passed unhandled Variant with TYPE_* enum " +
-						itos(args[i].get_type()) +
-						". Please serialize your object into a String or a PoolByteArray.";
-		}
+int SQLiteBindPlan::bind_float(SQLiteBindPlan *p_plan, sqlite3_stmt *p_stmt, int p_index, const Variant &p_value) {
+	return sqlite3_bind_double(p_stmt, p_index, (double)p_value);
+}
 
-		if (retcode != SQLITE_OK) {
-			return "SQLiteQuery failed, an error occurred while binding argument" +
-					itos(i + 1) + " of " + itos(args.size()) + " (SQLite errcode " +
-					itos(retcode) + ")";
+// Scratch buffers above this size are let go when the bindings are
+// released, so one huge string does not stay pinned by the plan.
+static const uint32_t MAX_IDLE_TEXT_SIZE = 64 * 1024;
+
+// Encodes straight into the scratch buffer of the slot, which keeps its
+// capacity between executions, instead of allocating a CharString like
+// String::utf8() does. The buffer is sized to the exact encoded length.
+static int64_t encode_utf8(const String &p_string, LocalVector<char> &r_buffer) {
+	const int64_t length = p_string.length();
+	const char32_t *src = p_string.ptr();
+	int64_t size = length;
+	for (int64_t i = 0; i < length; i++) {
+		const uint32_t c = src[i];
+		if (c < 0x80) {
+			continue;
 		}
+		// Characters that cannot be encoded become U+FFFD, 3 bytes.
+		size += c < 0x800 ? 1 : (c < 0x10000 || c > 0x10ffff ? 2 : 3);
 	}
-
-	return "";
+	r_buffer.resize(size + 1);
+	uint8_t *dst = (uint8_t *)r_buffer.ptr();
+	uint8_t *out = dst;
+	for (int64_t i = 0; i < length; i++) {
+		uint32_t c = src[i];
+		if (c < 0x80) {
+			*out++ = c;
+			continue;
+		}
+		if ((c >= 0xd800 && c <= 0xdfff) || c > 0x10ffff) {
+			c = 0xfffd; // Not encodable, store the replacement character.
+		}
+		if (c < 0x800) {
+			*out++ = 0xc0 | (c >> 6);
+		} else if (c < 0x10000) {
+			*out++ = 0xe0 | (c >> 12);
+			*out++ = 0x80 | ((c >> 6) & 0x3f);
+		} else {
+			*out++ = 0xf0 | (c >> 18);
+			*out++ = 0x80 | ((c >> 12) & 0x3f);
+			*out++ = 0x80 | ((c >> 6) & 0x3f);
+		}
+		*out++ = 0x80 | (c & 0x3f);
+	}
+	*out = 0;
+	return out - dst;
 }
 
-bool SQLiteAccess::open_buffered(const String &name, const PackedByteArray &buffers, int64_t size) {
-	if (!name.strip_edges().length()) {
-		return false;
-	}
+int SQLiteBindPlan::bind_text(SQLiteBindPlan *p_plan, sqlite3_stmt *p_stmt, int p_index, const Variant &p_value) {
+	return p_plan->bind_string(p_stmt, p_index - 1, p_value.operator String());
+}
 
-	if (!buffers.size() || !size) {
-		return false;
-	}
+int SQLiteBindPlan::bind_string(sqlite3_stmt *p_stmt, int p_slot, const String &p_value) {
+	LocalVector<char> &text = texts[p_slot];
+	const int64_t size = encode_utf8(p_value, text);
+	pinned = true;
+	return sqlite3_bind_text64(p_stmt, p_slot + 1, text.ptr(), size, SQLITE_STATIC, SQLITE_UTF8);
+}
 
-	spmembuffer_t *p_mem = (spmembuffer_t *)calloc(1, sizeof(spmembuffer_t));
-	p_mem->total = p_mem->used = size;
-	p_mem->data = (char *)malloc(size + 1);
-	memcpy(p_mem->data, buffers.ptr(), size);
-	p_mem->data[size] = '\0';
+int SQLiteBindPlan::bind_blob(SQLiteBindPlan *p_plan, sqlite3_stmt *p_stmt, int p_index, const Variant &p_value) {
+	// Shares the data of the argument, nothing is copied.
+	PackedByteArray &blob = p_plan->blobs[p_index - 1];
+	blob = p_value;
+	p_plan->pinned = true;
+	return sqlite3_bind_blob64(p_stmt, p_index, blob.ptr(), blob.size(), SQLITE_STATIC);
+}
 
-	spmemvfs_env_init();
-	int err = spmemvfs_open_db(&spmemvfs_db, name.utf8().get_data(), p_mem);
+SQLiteBindPlan::Binder SQLiteBindPlan::get_binder(Variant::Type p_type) {
+	switch (p_type) {
+		case Variant::Type::NIL:
+			return bind_null;
+		case Variant::Type::BOOL:
+		case Variant::Type::INT:
+			return bind_int;
+		case Variant::Type::FLOAT:
+			return bind_float;
+		case Variant::Type::STRING:
+			return bind_text;
+		case Variant::Type::PACKED_BYTE_ARRAY:
+			return bind_blob;
+		default:
+			return nullptr;
+	}
+}
 
-	if (err != SQLITE_OK || spmemvfs_db.mem != p_mem) {
-		print_error("Cannot open buffered database!");
-		return false;
+static String bind_error(const Variant &p_value, int p_index, int p_count, int p_retcode) {
+	if (p_retcode == SQLITE_OK) {
+		return "SQLite was passed unhandled Variant with TYPE_* enum " +
+				itos(p_value.get_type()) +
+				". Please serialize your object into a String or a PoolByteArray.";
 	}
+	return "SQLiteQuery failed, an error occurred while binding argument" +
+			itos(p_index + 1) + " of " + itos(p_count) + " (SQLite errcode " +
+			itos(p_retcode) + ")";
+}
 
-	memory_read = true;
-	return true;
+void SQLiteBindPlan::init(sqlite3_stmt *p_stmt) {
+	param_count = sqlite3_bind_parameter_count(p_stmt);
+	types.resize(param_count);
+	binders.resize(param_count);
+	texts.resize(param_count);
+	blobs.resize(param_count);
+	for (int i = 0; i < param_count; i++) {
+		types[i] = Variant::VARIANT_MAX;
+		binders[i] = nullptr;
+	}
+}
+
+int SQLiteBindPlan::prepare(sqlite3_stmt *p_stmt) {
+	if (param_count < 0) {
+		init(p_stmt);
+	}
+	return param_count;
+}
+
+void SQLiteBindPlan::init_names(sqlite3_stmt *p_stmt) {
+	// Resolved once per statement, for both ":id" and plain "id". Anonymous
+	// "?" parameters have no name and can only be bound from an Array.
+	seen.resize(param_count);
+	for (int i = 0; i < param_count; i++) {
+		const char *name = sqlite3_bind_parameter_name(p_stmt, i + 1);
+		if (name == nullptr) {
+			continue;
+		}
+		const String full_name = String::utf8(name);
+		names.insert(full_name, i);
+		const String bare_name = full_name.substr(1);
+		if (!names.has(bare_name)) {
+			names.insert(bare_name, i);
+		}
+	}
+	names_ready = true;
+}
+
+String SQLiteBindPlan::bind_slot(sqlite3_stmt *p_stmt, int p_slot, const Variant &p_value) {
+	if (unlikely(p_value.get_type() != types[p_slot])) {
+		// First execution, or the caller changed the type of this slot.
+		Binder binder = get_binder(p_value.get_type());
+		if (binder == nullptr) {
+			return bind_error(p_value, p_slot, param_count, SQLITE_OK);
+		}
+		types[p_slot] = p_value.get_type();
+		binders[p_slot] = binder;
+	}
+
+	const int retcode = binders[p_slot](this, p_stmt, p_slot + 1, p_value);
+	if (retcode != SQLITE_OK) {
+		return bind_error(p_value, p_slot, param_count, retcode);
+	}
+	return "";
+}
+
+String SQLiteBindPlan::bind(sqlite3_stmt *p_stmt, const Variant &p_args) {
+	if (param_count < 0) {
+		init(p_stmt);
+	}
+
+	switch (p_args.get_type()) {
+		case Variant::NIL:
+			return bind_array(p_stmt, Array());
+		case Variant::ARRAY:
+			return bind_array(p_stmt, p_args);
+		case Variant::DICTIONARY:
+			return bind_dictionary(p_stmt, p_args);
+		default:
+			return "SQLiteQuery failed; arguments must be an Array or a Dictionary, got " + Variant::get_type_name(p_args.get_type());
+	}
+}
+
+String SQLiteBindPlan::bind_array(sqlite3_stmt *p_stmt, const Array &p_args) {
+	if (param_count != p_args.size()) {
+		return "SQLiteQuery failed; expected " + itos(param_count) + " arguments, got " + itos(p_args.size());
+	}
+
+	for (int i = 0; i < param_count; i++) {
+		const String error = bind_slot(p_stmt, i, p_args[i]);
+		if (!error.is_empty()) {
+			return error;
+		}
+	}
+
+	return "";
+}
+
+String SQLiteBindPlan::bind_dictionary(sqlite3_stmt *p_stmt, const Dictionary &p_args) {
+	if (!names_ready) {
+		init_names(p_stmt);
+	}
+	if (param_count > 0) {
+		memset(seen.ptr(), 0, param_count);
+	}
+
+	const Variant *key = nullptr;
+	while ((key = p_args.next(key))) {
+		const String name = *key;
+		const int *slot = names.getptr(name);
+		if (slot == nullptr) {
+			return "SQLiteQuery failed; the statement has no parameter named \"" + name + "\"";
+		}
+		if (seen[*slot]) {
+			return "SQLiteQuery failed; parameter \"" + name + "\" was given more than once";
+		}
+		seen[*slot] = 1;
+
+		const String error = bind_slot(p_stmt, *slot, p_args[*key]);
+		if (!error.is_empty()) {
+			return error;
+		}
+	}
+
+	for (int i = 0; i < param_count; i++) {
+		if (!seen[i]) {
+			const char *name = sqlite3_bind_parameter_name(p_stmt, i + 1);
+			if (name == nullptr) {
+				return "SQLiteQuery failed; parameter " + itos(i + 1) + " has no name and cannot be bound from a Dictionary";
+			}
+			return "SQLiteQuery failed; missing a value for parameter \"" + String::utf8(name) + "\"";
+		}
+	}
+
+	return "";
+}
+
+void SQLiteBindPlan::release(sqlite3_stmt *p_stmt) {
+	if (!pinned) {
+		return;
+	}
+	// SQLite must not see the buffers anymore before they are let go.
+	sqlite3_clear_bindings(p_stmt);
+	for (uint32_t i = 0; i < blobs.size(); i++) {
+		blobs[i] = PackedByteArray();
+	}
+	for (LocalVector<char> &text : texts) {
+		if (text.size() > MAX_IDLE_TEXT_SIZE) {
+			text.reset();
+		}
+	}
+	pinned = false;
+}
+
+bool SQLiteAccess::open_buffered(const String &name, const PackedByteArray &buffers, int64_t size, const Dictionary &p_options) {
+	if (!name.strip_edges().length()) {
+		return false;
+	}
+
+	if (!buffers.size() || !size) {
+		return false;
+	}
+
+	ERR_FAIL_COND_V_MSG(size > buffers.size(), false, "The buffer is smaller than the given size.");
+	// spmemvfs always opens its database read-write with the default mutex
+	// mode, none of the flags of open() can be honored.
+	for (const char *flag : open_flag_options) {
+		ERR_FAIL_COND_V_MSG(p_options.get(flag, false), false, vformat("Open option %s is not supported by buffered databases.", flag));
+	}
+
+	spmembuffer_t *p_mem = spmembuffer_create(buffers.ptr(), size);
+	ERR_FAIL_NULL_V_MSG(p_mem, false, "Cannot allocate the buffered database.");
+
+	if (spmemvfs_env_init() != SQLITE_OK) {
+		spmembuffer_free(p_mem);
+		print_error("Cannot register the buffered database VFS!");
+		return false;
+	}
+
+	// The buffer is owned by spmemvfs_db from here on, or freed on failure.
+	int err = spmemvfs_open_db(&spmemvfs_db, name.utf8().get_data(), p_mem);
+
+	if (err != SQLITE_OK) {
+		spmemvfs_env_fini();
+		print_error("Cannot open buffered database!");
+		return false;
+	}
+
+	memory_read = true;
+	return finish_open(p_options);
 }
 
 bool SQLiteAccess::backup(const String &path) {
@@ -459,10 +1401,85 @@ bool SQLiteAccess::backup(const String &path) {
 	return true;
 }
 
-Ref<SQLiteQueryResult> SQLiteQuery::execute(const Array p_args) {
+// An empty Array or Dictionary means the arguments given to create_query().
+static bool has_arguments(const Variant &p_args) {
+	switch (p_args.get_type()) {
+		case Variant::NIL:
+			return false;
+		case Variant::ARRAY:
+			return !p_args.operator Array().is_empty();
+		case Variant::DICTIONARY:
+			return !p_args.operator Dictionary().is_empty();
+		default:
+			return true;
+	}
+}
+
+Ref<SQLiteQueryResult> SQLiteQuery::execute(const Variant &p_args) {
+	return run(p_args, false);
+}
+
+Ref<SQLiteQueryResult> SQLiteQuery::execute_columnar(const Variant &p_args) {
+	return run(p_args, true);
+}
+
+Ref<SQLiteQueryResult> SQLiteQuery::run(const Variant &p_args, bool p_columnar) {
+	const uint64_t start = OS::get_singleton()->get_ticks_usec();
+	Ref<SQLiteQueryResult> result = execute_statement(p_args, p_columnar);
+	const uint64_t usec = OS::get_singleton()->get_ticks_usec() - start;
+	SQLiteStatistics::record_query(usec);
+
+	if (db != nullptr) {
+		const uint64_t threshold = db->slow_query_usec.get();
+		if (threshold > 0 && usec >= threshold) {
+			db->log_slow_query(query, has_arguments(p_args) ? p_args : Variant(arguments), usec);
+		}
+	}
+	return result;
+}
+
+Ref<SQLiteQueryResult> SQLiteQuery::execute_statement(const Variant &p_args, bool p_columnar) {
 	Ref<SQLiteQueryResult> result;
 	result.instantiate();
 	result->set_query(query);
+	if (db == nullptr) {
+		result->set_error("Database is undefined.");
+		result->set_error_code(SQLITE_MISUSE);
+		return result;
+	}
+
+	const Variant args = has_arguments(p_args) ? p_args : Variant(arguments);
+
+	// Read-only statements go to an idle reader of the pool, without taking
+	// the writer lock. Inside a transaction they must see its changes, so
+	// they stay on the writer. The writer publishes its transaction state
+	// whenever it unlocks, see SQLiteWriterLock.
+	if (read_only && cursor == nullptr && db->writer_autocommit.is_set()) {
+		RWLockRead pool_lock(db->read_pool_lock);
+		SQLiteReader *reader = db->acquire_reader();
+		if (reader != nullptr) {
+			sqlite3_stmt *reader_stmt = nullptr;
+			SQLiteBindPlan *reader_plan = nullptr;
+			if (reader->statement_cache.checkout(reader->handle, statement_key, &reader_stmt, &reader_plan) != SQLITE_OK) {
+				result->set_error(sqlite3_errmsg(reader->handle));
+				result->set_error_code(sqlite3_errcode(reader->handle));
+			} else if (step_statement(reader_stmt, reader_plan, args, p_columnar, result) == SQLITE_OK) {
+				reader->statement_cache.checkin(statement_key, reader_stmt, reader_plan);
+			} else {
+				sqlite3_finalize(reader_stmt);
+				memdelete(reader_plan);
+			}
+			db->release_reader(reader);
+			return result;
+		}
+	}
+
+	SQLiteWriterLock lock(db);
+	if (cursor != nullptr) {
+		result->set_error("Query has an open cursor");
+		result->set_error_code(SQLITE_MISUSE);
+		return result;
+	}
 	if (!is_ready()) {
 		if (!prepare()) {
 			result->set_error("Query is not ready");
@@ -472,39 +1489,80 @@ Ref<SQLiteQueryResult> SQLiteQuery::execute(const Array p_args) {
 	}
 
 	ERR_FAIL_NULL_V(stmt, Variant());
-	Array args = p_args;
-	if (args.is_empty()) {
-		args = arguments;
+	if (SQLITE_OK != step_statement(stmt, bind_plan, args, p_columnar, result)) {
+		finalize();
+		ERR_FAIL_V_MSG(result, "Was not possible to reset the query: " + get_last_error_message());
 	}
-	String bind_err_msg = SQLiteAccess::bind_args(stmt, args);
+	return result;
+}
+
+int SQLiteQuery::step_statement(sqlite3_stmt *p_stmt, SQLiteBindPlan *p_plan, const Variant &p_args, bool p_columnar, const Ref<SQLiteQueryResult> &r_result) {
+	sqlite3 *handle = sqlite3_db_handle(p_stmt);
+	String bind_err_msg = p_plan->bind(p_stmt, p_args);
 	if (bind_err_msg != "") {
-		result->set_error_code(db->get_last_error_code());
-		result->set_error(bind_err_msg);
-		return result;
+		p_plan->release(p_stmt);
+		r_result->set_error_code(sqlite3_errcode(handle));
+		r_result->set_error(bind_err_msg);
+		return SQLITE_OK;
 	}
 
 	TypedArray<Array> results;
+	LocalVector<ColumnBuilder> columns;
+	const LocalVector<SQLiteBindPlan::Decoder> *decoders = nullptr;
+	int column_count = sqlite3_column_count(p_stmt);
+	uint64_t row_count = 0;
+	if (p_columnar) {
+		columns.resize(column_count);
+	}
 	while (true) {
-		const int res = sqlite3_step(stmt);
+		const int res = sqlite3_step(p_stmt);
 		if (res == SQLITE_ROW) {
-			results.append(fast_parse_row(stmt));
+			row_count++;
+			if (unlikely(decoders == nullptr)) {
+				// The first step may have re-prepared the statement.
+				decoders = &p_plan->get_decoders(p_stmt);
+				column_count = decoders->size();
+				if (p_columnar) {
+					columns.resize(column_count);
+					for (int i = 0; i < column_count; i++) {
+						columns[i].seed(p_plan->get_storage_class(i));
+					}
+				}
+			}
+			if (p_columnar) {
+				for (int i = 0; i < column_count; i++) {
+					columns[i].append(p_stmt, i);
+				}
+			} else {
+				results.append(decode_row(p_stmt, *decoders));
+			}
 		} else if (res == SQLITE_DONE) {
 			break;
 		} else {
-			result->set_error_code(res);
-			result->set_error(get_last_error_message());
-			ERR_BREAK_MSG(true, "There was an error during an SQL execution: " + get_last_error_message());
+			r_result->set_error_code(res);
+			r_result->set_error(sqlite3_errmsg(handle));
+			ERR_BREAK_MSG(true, "There was an error during an SQL execution: " + String::utf8(sqlite3_errmsg(handle)));
 		}
 	}
-	result->set_result(results);
-
-	if (SQLITE_OK != sqlite3_reset(stmt)) {
-		finalize();
-		ERR_FAIL_V_MSG(result, "Was not possible to reset the query: " + get_last_error_message());
-		result->set_error_code(db->get_last_error_code());
-		result->set_error(get_last_error_message());
+	if (p_columnar) {
+		Array column_arrays;
+		column_arrays.resize(column_count);
+		for (int i = 0; i < column_count; i++) {
+			column_arrays[i] = columns[i].finish();
+		}
+		r_result->set_columns(column_arrays);
+		r_result->set_column_names(column_names(p_stmt));
+	} else {
+		r_result->set_result(results);
 	}
-	return result;
+	SQLiteStatistics::record_rows(row_count);
+	if (db->statement_status_enabled.is_set()) {
+		r_result->set_statement_status(statement_status(p_stmt));
+	}
+
+	const int res = sqlite3_reset(p_stmt);
+	p_plan->release(p_stmt);
+	return res;
 }
 
 TypedArray<SQLiteQueryResult> SQLiteQuery::batch_execute(TypedArray<Array> p_rows) {
@@ -520,6 +1578,570 @@ TypedArray<SQLiteQueryResult> SQLiteQuery::batch_execute(TypedArray<Array> p_row
 	return res;
 }
 
+int SQLiteQuery::step_to_end() {
+	while (true) {
+		const int res = sqlite3_step(stmt);
+		if (res == SQLITE_DONE) {
+			return SQLITE_OK;
+		}
+		if (res != SQLITE_ROW) {
+			return res;
+		}
+	}
+}
+
+// Stops a batch on an error that leaves the transaction unusable.
+// p_counted tells whether the row is already in failed_rows.
+static void abort_batch(const Ref<SQLiteBatchResult> &r_result, int64_t p_row, bool p_counted, const String &p_error, int p_error_code) {
+	if (r_result->get_failed_row() < 0) {
+		r_result->set_failed_row(p_row);
+	}
+	if (!p_counted) {
+		r_result->set_failed_rows(r_result->get_failed_rows() + 1);
+	}
+	r_result->set_error(p_error);
+	r_result->set_error_code(p_error_code);
+}
+
+Ref<SQLiteBatchResult> SQLiteQuery::batch_execute_transaction(TypedArray<Array> p_rows, bool p_savepoint_per_row) {
+	Ref<SQLiteBatchResult> result;
+	result.instantiate();
+	if (db == nullptr) {
+		result->set_error("Database is undefined.");
+		result->set_error_code(SQLITE_MISUSE);
+		return result;
+	}
+
+	const uint64_t start_usec = OS::get_singleton()->get_ticks_usec();
+	SQLiteWriterLock lock(db);
+	if (cursor != nullptr) {
+		result->set_error("Query has an open cursor");
+		result->set_error_code(SQLITE_MISUSE);
+		return result;
+	}
+	if (!is_ready()) {
+		if (!prepare()) {
+			result->set_error("Query is not ready");
+			result->set_error_code(db->get_last_error_code());
+			return result;
+		}
+	}
+
+	sqlite3 *handle = db->get_handler();
+	bool nested = false;
+	if (!db->begin_batch(nested)) {
+		result->set_error(get_last_error_message());
+		result->set_error_code(db->get_last_error_code());
+		return result;
+	}
+
+	int64_t rows_affected = 0;
+	bool commit = true;
+	for (int64_t i = 0; i < p_rows.size(); i++) {
+		if (p_savepoint_per_row && db->exec("SAVEPOINT sqlite_batch_row") != SQLITE_OK) {
+			abort_batch(result, i, false, get_last_error_message(), db->get_last_error_code());
+			commit = false;
+			break;
+		}
+
+		String error;
+		int res = SQLITE_OK;
+		const int64_t changes = sqlite3_total_changes64(handle);
+		String bind_err_msg = bind_plan->bind(stmt, p_rows[i]);
+		if (bind_err_msg != "") {
+			error = bind_err_msg;
+			res = SQLITE_MISUSE;
+		} else {
+			res = step_to_end();
+			if (res != SQLITE_OK) {
+				error = get_last_error_message();
+			}
+		}
+		sqlite3_reset(stmt);
+
+		if (res == SQLITE_OK) {
+			if (p_savepoint_per_row && db->exec("RELEASE sqlite_batch_row") != SQLITE_OK) {
+				abort_batch(result, i, false, get_last_error_message(), db->get_last_error_code());
+				commit = false;
+				break;
+			}
+			// sqlite3_changes64() keeps the count of the last INSERT, UPDATE
+			// or DELETE, so statements that change nothing would count it again.
+			rows_affected += sqlite3_total_changes64(handle) - changes;
+			continue;
+		}
+
+		if (result->get_failed_row() < 0) {
+			result->set_failed_row(i);
+			result->set_error(error);
+			result->set_error_code(res);
+		}
+		result->set_failed_rows(result->get_failed_rows() + 1);
+		if (!p_savepoint_per_row) {
+			commit = false;
+			break;
+		}
+
+		// SQLITE_FULL, SQLITE_IOERR, SQLITE_BUSY or SQLITE_NOMEM can roll back
+		// the whole transaction, the next rows would then run in autocommit.
+		if (sqlite3_get_autocommit(handle) != 0) {
+			abort_batch(result, i, true, "The transaction was rolled back: " + error, res);
+			commit = false;
+			break;
+		}
+		// Undo only this row and keep going.
+		if (db->exec("ROLLBACK TO sqlite_batch_row") != SQLITE_OK || db->exec("RELEASE sqlite_batch_row") != SQLITE_OK) {
+			abort_batch(result, i, true, get_last_error_message(), db->get_last_error_code());
+			commit = false;
+			break;
+		}
+	}
+	if (!commit) {
+		rows_affected = 0;
+	}
+	bind_plan->release(stmt);
+
+	if (!db->end_batch(nested, commit) && commit) {
+		rows_affected = 0;
+		if (result->get_error_code() == SQLITE_OK) {
+			result->set_error(get_last_error_message());
+			result->set_error_code(db->get_last_error_code());
+		}
+	}
+	result->set_rows_affected(rows_affected);
+	result->set_last_insert_rowid(sqlite3_last_insert_rowid(handle));
+	result->set_elapsed_usec(OS::get_singleton()->get_ticks_usec() - start_usec);
+	return result;
+}
+
+// One packed array argument of batch_execute_columns(), read in place.
+struct ColumnSource {
+	enum Kind {
+		KIND_INT32,
+		KIND_INT64,
+		KIND_FLOAT32,
+		KIND_FLOAT64,
+		KIND_STRING,
+		KIND_VARIANT,
+	};
+
+	Kind kind = KIND_VARIANT;
+	Variant array; // Keeps the packed data alive while it is read.
+	const void *data = nullptr;
+	int64_t size = 0;
+
+	bool init(const Variant &p_array) {
+		array = p_array;
+		switch (p_array.get_type()) {
+			case Variant::PACKED_INT32_ARRAY: {
+				const PackedInt32Array &values = *VariantInternal::get_int32_array(&array);
+				kind = KIND_INT32;
+				data = values.ptr();
+				size = values.size();
+			} break;
+			case Variant::PACKED_INT64_ARRAY: {
+				const PackedInt64Array &values = *VariantInternal::get_int64_array(&array);
+				kind = KIND_INT64;
+				data = values.ptr();
+				size = values.size();
+			} break;
+			case Variant::PACKED_FLOAT32_ARRAY: {
+				const PackedFloat32Array &values = *VariantInternal::get_float32_array(&array);
+				kind = KIND_FLOAT32;
+				data = values.ptr();
+				size = values.size();
+			} break;
+			case Variant::PACKED_FLOAT64_ARRAY: {
+				const PackedFloat64Array &values = *VariantInternal::get_float64_array(&array);
+				kind = KIND_FLOAT64;
+				data = values.ptr();
+				size = values.size();
+			} break;
+			case Variant::PACKED_STRING_ARRAY: {
+				const PackedStringArray &values = *VariantInternal::get_string_array(&array);
+				kind = KIND_STRING;
+				data = values.ptr();
+				size = values.size();
+			} break;
+			case Variant::ARRAY: {
+				const Array &values = *VariantInternal::get_array(&array);
+				kind = KIND_VARIANT;
+				size = values.size();
+			} break;
+			default:
+				return false;
+		}
+		return true;
+	}
+
+	String bind(SQLiteBindPlan *p_plan, sqlite3_stmt *p_stmt, int p_slot, int64_t p_row) const {
+		int retcode = SQLITE_OK;
+		switch (kind) {
+			case KIND_INT32:
+				retcode = sqlite3_bind_int64(p_stmt, p_slot + 1, ((const int32_t *)data)[p_row]);
+				break;
+			case KIND_INT64:
+				retcode = sqlite3_bind_int64(p_stmt, p_slot + 1, ((const int64_t *)data)[p_row]);
+				break;
+			case KIND_FLOAT32:
+				retcode = sqlite3_bind_double(p_stmt, p_slot + 1, ((const float *)data)[p_row]);
+				break;
+			case KIND_FLOAT64:
+				retcode = sqlite3_bind_double(p_stmt, p_slot + 1, ((const double *)data)[p_row]);
+				break;
+			case KIND_STRING:
+				retcode = p_plan->bind_string(p_stmt, p_slot, ((const String *)data)[p_row]);
+				break;
+			case KIND_VARIANT:
+				return p_plan->bind_slot(p_stmt, p_slot, VariantInternal::get_array(&array)->operator[](p_row));
+		}
+		if (retcode != SQLITE_OK) {
+			return "SQLiteQuery failed, an error occurred while binding column " + itos(p_slot + 1) + " of row " + itos(p_row) + " (SQLite errcode " + itos(retcode) + ")";
+		}
+		return "";
+	}
+};
+
+Ref<SQLiteBatchResult> SQLiteQuery::batch_execute_columns(const Array &p_columns) {
+	Ref<SQLiteBatchResult> result;
+	result.instantiate();
+	if (db == nullptr) {
+		result->set_error("Database is undefined.");
+		result->set_error_code(SQLITE_MISUSE);
+		return result;
+	}
+
+	const uint64_t start_usec = OS::get_singleton()->get_ticks_usec();
+	SQLiteWriterLock lock(db);
+	if (cursor != nullptr) {
+		result->set_error("Query has an open cursor");
+		result->set_error_code(SQLITE_MISUSE);
+		return result;
+	}
+	if (!is_ready()) {
+		if (!prepare()) {
+			result->set_error("Query is not ready");
+			result->set_error_code(db->get_last_error_code());
+			return result;
+		}
+	}
+
+	const int param_count = bind_plan->prepare(stmt);
+	if (param_count != p_columns.size()) {
+		result->set_error("SQLiteQuery failed; expected " + itos(param_count) + " columns, got " + itos(p_columns.size()));
+		result->set_error_code(SQLITE_MISUSE);
+		return result;
+	}
+
+	LocalVector<ColumnSource> sources;
+	sources.resize(param_count);
+	int64_t row_count = param_count > 0 ? -1 : 0;
+	for (int i = 0; i < param_count; i++) {
+		if (!sources[i].init(p_columns[i])) {
+			result->set_error("SQLiteQuery failed; column " + itos(i + 1) + " is a " + Variant::get_type_name(p_columns[i].get_type()) + ", expected a packed array or an Array");
+			result->set_error_code(SQLITE_MISUSE);
+			return result;
+		}
+		if (row_count >= 0 && sources[i].size != row_count) {
+			result->set_error("SQLiteQuery failed; all columns must have the same size");
+			result->set_error_code(SQLITE_MISUSE);
+			return result;
+		}
+		row_count = sources[i].size;
+	}
+
+	sqlite3 *handle = db->get_handler();
+	bool nested = false;
+	if (!db->begin_batch(nested)) {
+		result->set_error(get_last_error_message());
+		result->set_error_code(db->get_last_error_code());
+		return result;
+	}
+
+	int64_t rows_affected = 0;
+	bool commit = true;
+	for (int64_t row = 0; row < row_count && commit; row++) {
+		String error;
+		int res = SQLITE_OK;
+		const int64_t changes = sqlite3_total_changes64(handle);
+		for (int i = 0; i < param_count; i++) {
+			error = sources[i].bind(bind_plan, stmt, i, row);
+			if (!error.is_empty()) {
+				res = SQLITE_MISUSE;
+				break;
+			}
+		}
+		if (res == SQLITE_OK) {
+			res = step_to_end();
+			if (res != SQLITE_OK) {
+				error = get_last_error_message();
+			}
+		}
+		sqlite3_reset(stmt);
+
+		if (res == SQLITE_OK) {
+			rows_affected += sqlite3_total_changes64(handle) - changes;
+			continue;
+		}
+
+		result->set_failed_row(row);
+		result->set_failed_rows(1);
+		result->set_error(error);
+		result->set_error_code(res);
+		commit = false;
+		rows_affected = 0;
+	}
+	bind_plan->release(stmt);
+
+	if (!db->end_batch(nested, commit) && commit) {
+		rows_affected = 0;
+		if (result->get_error_code() == SQLITE_OK) {
+			result->set_error(get_last_error_message());
+			result->set_error_code(db->get_last_error_code());
+		}
+	}
+	result->set_rows_affected(rows_affected);
+	result->set_last_insert_rowid(sqlite3_last_insert_rowid(handle));
+	result->set_elapsed_usec(OS::get_singleton()->get_ticks_usec() - start_usec);
+	return result;
+}
+
+Ref<SQLiteCursor> SQLiteQuery::open_cursor(const Variant &p_args) {
+	ERR_FAIL_NULL_V_MSG(db, Ref<SQLiteCursor>(), "Database is undefined.");
+	SQLiteWriterLock lock(db);
+	ERR_FAIL_COND_V_MSG(cursor != nullptr, Ref<SQLiteCursor>(), "This query already has an open cursor.");
+
+	Ref<SQLiteCursor> new_cursor;
+	new_cursor.instantiate();
+	if (!is_ready()) {
+		if (!prepare()) {
+			new_cursor->done = true;
+			new_cursor->error = "Query is not ready";
+			new_cursor->error_code = db->get_last_error_code();
+			return new_cursor;
+		}
+	}
+
+	const Variant args = has_arguments(p_args) ? p_args : Variant(arguments);
+	String bind_err_msg = bind_plan->bind(stmt, args);
+	if (bind_err_msg != "") {
+		new_cursor->done = true;
+		new_cursor->error = bind_err_msg;
+		new_cursor->error_code = db->get_last_error_code();
+		return new_cursor;
+	}
+
+	new_cursor->query = Ref<SQLiteQuery>(this);
+	cursor = new_cursor.ptr();
+	return new_cursor;
+}
+
+struct SQLiteAsyncTask {
+	Ref<SQLiteQuery> query;
+	Ref<SQLiteAccess> access;
+	Ref<SQLiteAsyncResult> handle;
+	Variant arguments;
+};
+
+void SQLiteQuery::execute_async_task(void *p_userdata) {
+	SQLiteAsyncTask *task = (SQLiteAsyncTask *)p_userdata;
+	SQLiteAccess *access = task->query->db;
+	bool open = false;
+	if (access != nullptr) {
+		MutexLock lock(access->mutex);
+		open = access->get_handler() != nullptr;
+	}
+
+	// close() may have run between execute_async() and now. If it runs
+	// after this check, the query fails to prepare instead.
+	Ref<SQLiteQueryResult> result;
+	if (open) {
+		result = task->query->execute(task->arguments);
+	} else {
+		result.instantiate();
+		result->set_query(task->query->query);
+		result->set_error("The database was closed before the query ran.");
+		result->set_error_code(SQLITE_MISUSE);
+	}
+	callable_mp_static(&SQLiteAsyncResult::deliver).call_deferred(task->handle, result);
+	memdelete(task);
+}
+
+Ref<SQLiteAsyncResult> SQLiteQuery::execute_async(const Variant &p_args) {
+	ERR_FAIL_NULL_V_MSG(db, Ref<SQLiteAsyncResult>(), "Database is undefined.");
+	ERR_FAIL_COND_V_MSG(db->open_options.get("no_mutex", false), Ref<SQLiteAsyncResult>(), "execute_async() cannot be used on a connection opened with no_mutex.");
+
+	Ref<SQLiteAsyncResult> handle;
+	handle.instantiate();
+
+	// The task keeps the query and its connection alive until it ran.
+	SQLiteAsyncTask *task = memnew(SQLiteAsyncTask);
+	task->query = Ref<SQLiteQuery>(this);
+	task->access = Ref<SQLiteAccess>(db);
+	task->handle = handle;
+	task->arguments = p_args.duplicate();
+
+	handle->task_id.set(WorkerThreadPool::get_singleton()->add_native_task(&SQLiteQuery::execute_async_task, task, false, "SQLiteQuery.execute_async"));
+	return handle;
+}
+
+void SQLiteAsyncResult::deliver(const Ref<SQLiteAsyncResult> &p_handle, const Ref<SQLiteQueryResult> &p_result) {
+	const WorkerThreadPool::TaskID id = p_handle->task_id.get();
+	if (id == WorkerThreadPool::INVALID_TASK_ID) {
+		// execute_async() was called off the main thread and has not stored the id yet.
+		callable_mp_static(&SQLiteAsyncResult::deliver).call_deferred(p_handle, p_result);
+		return;
+	}
+
+	// The task is past its last statement, this only releases it.
+	WorkerThreadPool::get_singleton()->wait_for_task_completion(id);
+	p_handle->result = p_result;
+	p_handle->completed = true;
+	p_handle->emit_signal(SNAME("completed"), p_result);
+}
+
+void SQLiteAsyncResult::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("is_completed"), &SQLiteAsyncResult::is_completed);
+	ClassDB::bind_method(D_METHOD("get_result"), &SQLiteAsyncResult::get_result);
+
+	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "result", PROPERTY_HINT_RESOURCE_TYPE, "SQLiteQueryResult"), "", "get_result");
+
+	ADD_SIGNAL(MethodInfo("completed", PropertyInfo(Variant::OBJECT, "result", PROPERTY_HINT_RESOURCE_TYPE, "SQLiteQueryResult")));
+}
+
+SQLiteCursor::~SQLiteCursor() {
+	close();
+}
+
+bool SQLiteCursor::step(bool &r_has_row) {
+	r_has_row = false;
+	if (done) {
+		return false;
+	}
+	if (query.is_null() || query->stmt == nullptr) {
+		done = true;
+		return false;
+	}
+
+	const int res = sqlite3_step(query->stmt);
+	if (res == SQLITE_ROW) {
+		r_has_row = true;
+		return true;
+	}
+	if (res != SQLITE_DONE) {
+		error_code = res;
+		error = query->get_last_error_message();
+		ERR_PRINT("There was an error during an SQL execution: " + error);
+	}
+	// Reset right away so the read lock is not held until close().
+	done = true;
+	sqlite3_reset(query->stmt);
+	query->bind_plan->release(query->stmt);
+	// Cursors have no result, drop the counters of this run.
+	if (query->db->statement_status_enabled.is_set()) {
+		statement_status(query->stmt);
+	}
+	return false;
+}
+
+TypedArray<Array> SQLiteCursor::fetch(int64_t p_count) {
+	TypedArray<Array> rows;
+	if (query.is_null() || query->db == nullptr) {
+		done = true;
+		return rows;
+	}
+
+	SQLiteWriterLock lock(query->db);
+	bool has_row = false;
+	for (int64_t i = 0; p_count < 0 || i < p_count; i++) {
+		if (!step(has_row)) {
+			break;
+		}
+		rows.append(decode_row(query->stmt, query->bind_plan->get_decoders(query->stmt)));
+	}
+	SQLiteStatistics::record_rows(rows.size());
+	return rows;
+}
+
+Array SQLiteCursor::fetch_columnar(int64_t p_count) {
+	Array column_arrays;
+	if (query.is_null() || query->db == nullptr) {
+		done = true;
+		return column_arrays;
+	}
+
+	SQLiteWriterLock lock(query->db);
+	if (query->stmt == nullptr) {
+		done = true;
+		return column_arrays;
+	}
+
+	const int column_count = sqlite3_column_count(query->stmt);
+	LocalVector<ColumnBuilder> columns;
+	columns.resize(column_count);
+	for (int i = 0; i < column_count; i++) {
+		columns[i].seed(declared_storage_class(sqlite3_column_decltype(query->stmt, i)));
+	}
+	bool has_row = false;
+	uint64_t row_count = 0;
+	for (int64_t i = 0; p_count < 0 || i < p_count; i++) {
+		if (!step(has_row)) {
+			break;
+		}
+		for (int j = 0; j < column_count; j++) {
+			columns[j].append(query->stmt, j);
+		}
+		row_count++;
+	}
+	SQLiteStatistics::record_rows(row_count);
+
+	column_arrays.resize(column_count);
+	for (int i = 0; i < column_count; i++) {
+		column_arrays[i] = columns[i].finish();
+	}
+	return column_arrays;
+}
+
+PackedStringArray SQLiteCursor::get_column_names() const {
+	if (query.is_null() || query->db == nullptr) {
+		return PackedStringArray();
+	}
+
+	MutexLock lock(query->db->mutex);
+	if (query->stmt == nullptr) {
+		return PackedStringArray();
+	}
+	return column_names(query->stmt);
+}
+
+void SQLiteCursor::close() {
+	if (query.is_valid()) {
+		if (query->db != nullptr) {
+			SQLiteWriterLock lock(query->db);
+			if (!done && query->stmt != nullptr) {
+				sqlite3_reset(query->stmt);
+				query->bind_plan->release(query->stmt);
+				if (query->db->statement_status_enabled.is_set()) {
+					statement_status(query->stmt);
+				}
+			}
+		}
+		query->cursor = nullptr;
+		query.unref();
+	}
+	done = true;
+}
+
+void SQLiteCursor::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("fetch", "count"), &SQLiteCursor::fetch, DEFVAL(-1));
+	ClassDB::bind_method(D_METHOD("fetch_columnar", "count"), &SQLiteCursor::fetch_columnar, DEFVAL(-1));
+	ClassDB::bind_method(D_METHOD("get_column_names"), &SQLiteCursor::get_column_names);
+	ClassDB::bind_method(D_METHOD("is_done"), &SQLiteCursor::is_done);
+	ClassDB::bind_method(D_METHOD("get_error"), &SQLiteCursor::get_error);
+	ClassDB::bind_method(D_METHOD("get_error_code"), &SQLiteCursor::get_error_code);
+	ClassDB::bind_method(D_METHOD("close"), &SQLiteCursor::close);
+}
+
 Ref<SQLiteQuery> SQLiteAccess::create_query(String p_query, Array p_args) {
 	Ref<SQLiteQuery> query;
 	query.instantiate();
@@ -527,7 +2149,412 @@ Ref<SQLiteQuery> SQLiteAccess::create_query(String p_query, Array p_args) {
 
 	WeakRef *wr = memnew(WeakRef);
 	wr->set_obj(query.ptr());
+	MutexLock lock(mutex);
+	if (queries.size() >= queries_prune_at) {
+		// Drop the queries that are gone, so repeated create_query() calls do
+		// not grow the list until close().
+		uint32_t live = 0;
+		for (uint32_t i = 0; i < queries.size(); i++) {
+			if (queries[i]->get_ref().get_type() == Variant::NIL) {
+				memdelete(queries[i]);
+			} else {
+				queries[live++] = queries[i];
+			}
+		}
+		queries.resize(live);
+		queries_prune_at = MAX(live * 2, (uint32_t)64);
+	}
 	queries.push_back(wr);
 
 	return query;
 }
+
+int64_t SQLiteAccess::get_db_status(int p_op) const {
+	ERR_FAIL_INDEX_V(p_op, SQLITE_DBSTATUS_MAX + 1, 0);
+	// Only the writer connection, readers are opened NOMUTEX and belong to
+	// whichever thread checked them out. The monitors sample this on the main
+	// thread, so a connection busy with a query reports its last value
+	// instead of making the frame wait for it.
+	if (!mutex.try_lock()) {
+		return db_status[p_op].get();
+	}
+	sqlite3 *handle = get_handler();
+	int current = 0;
+	int highwater = 0;
+	if (handle != nullptr) {
+		sqlite3_db_status(handle, p_op, &current, &highwater, 0);
+	}
+	db_status[p_op].set(current);
+	mutex.unlock();
+	return current;
+}
+
+Dictionary SQLiteAccess::get_lookaside_stats(bool p_reset) const {
+	MutexLock lock(mutex);
+	Dictionary stats;
+	sqlite3 *handle = get_handler();
+	int current = 0;
+	int highwater = 0;
+	if (handle != nullptr) {
+		sqlite3_db_status(handle, SQLITE_DBSTATUS_LOOKASIDE_USED, &current, &highwater, p_reset);
+	}
+	stats["used"] = current;
+	stats["highwater"] = highwater;
+
+	// SQLite reports the hit and miss counters as highwater values.
+	static const struct {
+		int op;
+		const char *name;
+	} counters[] = {
+		{ SQLITE_DBSTATUS_LOOKASIDE_HIT, "hits" },
+		{ SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, "misses_size" },
+		{ SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, "misses_full" },
+	};
+	for (const auto &counter : counters) {
+		current = 0;
+		highwater = 0;
+		if (handle != nullptr) {
+			sqlite3_db_status(handle, counter.op, &current, &highwater, p_reset);
+		}
+		stats[counter.name] = highwater;
+	}
+	return stats;
+}
+
+Dictionary SQLiteAccess::get_page_cache_stats(bool p_reset) const {
+	static const struct {
+		int op;
+		const char *name;
+	} counters[] = {
+		{ SQLITE_DBSTATUS_CACHE_USED, "used_bytes" },
+		{ SQLITE_DBSTATUS_CACHE_HIT, "hits" },
+		{ SQLITE_DBSTATUS_CACHE_MISS, "misses" },
+		{ SQLITE_DBSTATUS_CACHE_WRITE, "writes" },
+		{ SQLITE_DBSTATUS_CACHE_SPILL, "spills" },
+	};
+
+	MutexLock lock(mutex);
+	Dictionary stats;
+	sqlite3 *handle = get_handler();
+	for (const auto &counter : counters) {
+		int current = 0;
+		int highwater = 0;
+		if (handle != nullptr) {
+			sqlite3_db_status(handle, counter.op, &current, &highwater, p_reset);
+		}
+		stats[counter.name] = current;
+	}
+	return stats;
+}
+
+int64_t SQLiteAccess::get_schema_version() {
+	// Runs straight from the statement cache, it is checked on every schema
+	// lookup of SQLiteDatabase and must not create a SQLiteQuery each time.
+	MutexLock lock(mutex);
+	sqlite3 *handle = get_handler();
+	if (handle == nullptr) {
+		return -1;
+	}
+	const String sql = "PRAGMA schema_version";
+	sqlite3_stmt *stmt = nullptr;
+	SQLiteBindPlan *plan = nullptr;
+	if (statement_cache.checkout(handle, sql, &stmt, &plan) != SQLITE_OK) {
+		return -1;
+	}
+	const int64_t version = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : -1;
+	sqlite3_reset(stmt);
+	statement_cache.checkin(sql, stmt, plan);
+	return version;
+}
+
+int SQLiteAccess::get_variable_limit() const {
+	MutexLock lock(mutex);
+	sqlite3 *handle = get_handler();
+	// SQLITE_MAX_VARIABLE_NUMBER default since 3.32.0.
+	return handle != nullptr ? sqlite3_limit(handle, SQLITE_LIMIT_VARIABLE_NUMBER, -1) : 32766;
+}
+
+int SQLiteAccess::trace_callback(unsigned p_type, void *p_context, void *p_stmt, void *p_nsec) {
+	if (p_type != SQLITE_TRACE_PROFILE) {
+		return 0;
+	}
+	SQLiteAccess *access = static_cast<SQLiteAccess *>(p_context);
+	sqlite3_stmt *stmt = static_cast<sqlite3_stmt *>(p_stmt);
+	const uint64_t nsec = *static_cast<const sqlite3_int64 *>(p_nsec);
+
+	// Literals are replaced by "?" when the normalizer is built in, so the
+	// same statement with inlined values lands in one entry.
+	const char *sql = nullptr;
+#ifdef SQLITE_ENABLE_NORMALIZE
+	sql = sqlite3_normalized_sql(stmt);
+#endif
+	if (sql == nullptr) {
+		sql = sqlite3_sql(stmt);
+	}
+	const String key = String::utf8(sql);
+
+	int bucket = 0;
+	const uint64_t usec = nsec / 1000;
+	while (bucket < QUERY_STATS_BUCKETS - 1 && (usec >> (bucket + 1)) != 0) {
+		bucket++;
+	}
+
+	MutexLock lock(access->query_stats_mutex);
+	QueryStats &stats = access->query_stats[key];
+	stats.calls++;
+	stats.total_nsec += nsec;
+	stats.min_nsec = MIN(stats.min_nsec, nsec);
+	stats.max_nsec = MAX(stats.max_nsec, nsec);
+	stats.histogram[bucket]++;
+	return 0;
+}
+
+void SQLiteAccess::apply_trace(sqlite3 *p_handle) {
+	if (p_handle == nullptr) {
+		return;
+	}
+	if (query_stats_enabled) {
+		sqlite3_trace_v2(p_handle, SQLITE_TRACE_PROFILE, &SQLiteAccess::trace_callback, this);
+	} else {
+		sqlite3_trace_v2(p_handle, 0, nullptr, nullptr);
+	}
+}
+
+void SQLiteAccess::set_query_stats_enabled(bool p_enabled) {
+	MutexLock lock(mutex);
+	query_stats_enabled = p_enabled;
+	apply_trace(get_handler());
+	// Readers belong to the thread that checked them out, wait until all
+	// of them are idle.
+	RWLockWrite pool_lock(read_pool_lock);
+	for (SQLiteReader *reader : readers) {
+		apply_trace(reader->handle);
+	}
+}
+
+bool SQLiteAccess::is_query_stats_enabled() const {
+	MutexLock lock(mutex);
+	return query_stats_enabled;
+}
+
+void SQLiteAccess::set_statement_status_enabled(bool p_enabled) {
+	statement_status_enabled.set_to(p_enabled);
+}
+
+bool SQLiteAccess::is_statement_status_enabled() const {
+	return statement_status_enabled.is_set();
+}
+
+Array SQLiteAccess::get_query_stats() const {
+	struct Entry {
+		const String *sql = nullptr;
+		const QueryStats *stats = nullptr;
+		bool operator<(const Entry &p_other) const {
+			return stats->total_nsec > p_other.stats->total_nsec;
+		}
+	};
+
+	Array result;
+	MutexLock lock(query_stats_mutex);
+	LocalVector<Entry> entries;
+	entries.reserve(query_stats.size());
+	for (const KeyValue<String, QueryStats> &E : query_stats) {
+		entries.push_back({ &E.key, &E.value });
+	}
+	entries.sort();
+
+	for (const Entry &entry : entries) {
+		const QueryStats &stats = *entry.stats;
+		PackedInt64Array histogram;
+		histogram.resize(QUERY_STATS_BUCKETS);
+		for (int i = 0; i < QUERY_STATS_BUCKETS; i++) {
+			histogram.set(i, stats.histogram[i]);
+		}
+
+		Dictionary row;
+		row["sql"] = *entry.sql;
+		row["calls"] = stats.calls;
+		row["total_msec"] = stats.total_nsec / 1000000.0;
+		row["average_msec"] = stats.total_nsec / 1000000.0 / stats.calls;
+		row["min_msec"] = stats.min_nsec / 1000000.0;
+		row["max_msec"] = stats.max_nsec / 1000000.0;
+		row["histogram"] = histogram;
+		result.push_back(row);
+	}
+	return result;
+}
+
+void SQLiteAccess::reset_query_stats() {
+	MutexLock lock(query_stats_mutex);
+	query_stats.clear();
+}
+
+// Keeps a slow query entry small: the first few arguments, with long
+// strings cut and blobs replaced by their size.
+static Variant sample_argument(const Variant &p_value) {
+	const int MAX_STRING_LENGTH = 64;
+	switch (p_value.get_type()) {
+		case Variant::STRING:
+		case Variant::STRING_NAME: {
+			const String value = p_value;
+			return value.length() > MAX_STRING_LENGTH ? value.substr(0, MAX_STRING_LENGTH) + "..." : value;
+		}
+		case Variant::PACKED_BYTE_ARRAY:
+			return vformat("<%d bytes>", PackedByteArray(p_value).size());
+		default:
+			return p_value;
+	}
+}
+
+static Variant sample_arguments(const Variant &p_args) {
+	const int MAX_ARGUMENTS = 8;
+	if (p_args.get_type() == Variant::ARRAY) {
+		const Array &args = p_args;
+		Array sample;
+		for (int i = 0; i < MIN(args.size(), MAX_ARGUMENTS); i++) {
+			sample.push_back(sample_argument(args[i]));
+		}
+		return sample;
+	}
+	if (p_args.get_type() == Variant::DICTIONARY) {
+		const Dictionary &args = p_args;
+		Dictionary sample;
+		const Array keys = args.keys();
+		for (int i = 0; i < MIN(keys.size(), MAX_ARGUMENTS); i++) {
+			sample[keys[i]] = sample_argument(args[keys[i]]);
+		}
+		return sample;
+	}
+	return Array();
+}
+
+String SQLiteAccess::explain_query_plan(const String &p_query) {
+	MutexLock lock(mutex);
+	sqlite3 *handle = get_handler();
+	if (handle == nullptr) {
+		return String();
+	}
+
+	// Parameters left unbound read as NULL, the plan does not depend on them.
+	const CharString sql = ("EXPLAIN QUERY PLAN " + p_query).utf8();
+	sqlite3_stmt *stmt = nullptr;
+	if (sqlite3_prepare_v2(handle, sql.get_data(), sql.length(), &stmt, nullptr) != SQLITE_OK) {
+		sqlite3_finalize(stmt);
+		return String();
+	}
+
+	// Rows are (id, parent, notused, detail), indent each under its parent.
+	HashMap<int, int> depths;
+	String plan;
+	while (sqlite3_step(stmt) == SQLITE_ROW) {
+		const int id = sqlite3_column_int(stmt, 0);
+		const int parent = sqlite3_column_int(stmt, 1);
+		const int *parent_depth = depths.getptr(parent);
+		const int depth = parent_depth != nullptr ? *parent_depth + 1 : 0;
+		depths[id] = depth;
+		plan += String("  ").repeat(depth) + String::utf8((const char *)sqlite3_column_text(stmt, 3)) + "\n";
+	}
+	sqlite3_finalize(stmt);
+	return plan;
+}
+
+void SQLiteAccess::log_slow_query(const String &p_query, const Variant &p_args, uint64_t p_usec) {
+	Dictionary entry;
+	entry["sql"] = p_query;
+	entry["arguments"] = sample_arguments(p_args);
+	entry["duration_msec"] = p_usec / 1000.0;
+	entry["time"] = Time::get_singleton()->get_unix_time_from_system();
+	entry["plan"] = explain_query_plan(p_query);
+
+	MutexLock lock(slow_queries_mutex);
+	if (slow_query_log_size > 0) {
+		if (slow_queries.size() < (uint32_t)slow_query_log_size) {
+			slow_queries.push_back(entry);
+		} else {
+			slow_queries[slow_queries_next] = entry;
+		}
+		slow_queries_next = (slow_queries_next + 1) % slow_query_log_size;
+	}
+
+	if (!slow_query_log_path.is_empty()) {
+		// One JSON object per line.
+		Ref<FileAccess> file = FileAccess::open(slow_query_log_path, FileAccess::exists(slow_query_log_path) ? FileAccess::READ_WRITE : FileAccess::WRITE);
+		ERR_FAIL_COND_MSG(file.is_null(), "Cannot open the slow query log: " + slow_query_log_path);
+		file->seek_end();
+		file->store_line(JSON::stringify(entry));
+	}
+}
+
+void SQLiteAccess::set_slow_query_threshold_msec(double p_msec) {
+	slow_query_usec.set(p_msec > 0.0 ? MAX((uint64_t)1, (uint64_t)(p_msec * 1000.0)) : 0);
+}
+
+double SQLiteAccess::get_slow_query_threshold_msec() const {
+	return slow_query_usec.get() / 1000.0;
+}
+
+void SQLiteAccess::set_slow_query_log_size(int p_size) {
+	ERR_FAIL_COND(p_size < 0);
+	MutexLock lock(slow_queries_mutex);
+	slow_query_log_size = p_size;
+	slow_queries.clear();
+	slow_queries_next = 0;
+}
+
+int SQLiteAccess::get_slow_query_log_size() const {
+	MutexLock lock(slow_queries_mutex);
+	return slow_query_log_size;
+}
+
+void SQLiteAccess::set_slow_query_log_path(const String &p_path) {
+	MutexLock lock(slow_queries_mutex);
+	slow_query_log_path = p_path;
+}
+
+String SQLiteAccess::get_slow_query_log_path() const {
+	MutexLock lock(slow_queries_mutex);
+	return slow_query_log_path;
+}
+
+Array SQLiteAccess::get_slow_queries() const {
+	MutexLock lock(slow_queries_mutex);
+	Array result;
+	// Oldest first, the ring starts at the next slot to overwrite once full.
+	const uint32_t start = slow_queries.size() < (uint32_t)slow_query_log_size ? 0 : slow_queries_next;
+	for (uint32_t i = 0; i < slow_queries.size(); i++) {
+		result.push_back(slow_queries[(start + i) % slow_queries.size()]);
+	}
+	return result;
+}
+
+void SQLiteAccess::clear_slow_queries() {
+	MutexLock lock(slow_queries_mutex);
+	slow_queries.clear();
+	slow_queries_next = 0;
+}
+
+void SQLiteAccess::set_statement_cache_capacity(int p_capacity) {
+	MutexLock lock(mutex);
+	statement_cache.set_capacity(p_capacity);
+}
+
+int SQLiteAccess::get_statement_cache_capacity() const {
+	return statement_cache.get_capacity();
+}
+
+int SQLiteAccess::get_statement_cache_size() const {
+	return statement_cache.get_size();
+}
+
+int64_t SQLiteAccess::get_statement_cache_hits() const {
+	return statement_cache.get_hits();
+}
+
+int64_t SQLiteAccess::get_statement_cache_misses() const {
+	return statement_cache.get_misses();
+}
+
+void SQLiteAccess::clear_statement_cache() {
+	MutexLock lock(mutex);
+	statement_cache.clear();
+}
@@ -32,6 +32,13 @@
 #define GODOT_SQLITE_H
 
 #include "core/object/ref_counted.h"
+#include "core/object/worker_thread_pool.h"
+#include "core/os/mutex.h"
+#include "core/os/rw_lock.h"
+#include "core/os/semaphore.h"
+#include "core/templates/safe_refcount.h"
+#include "core/templates/hash_map.h"
+#include "core/templates/list.h"
 #include "core/templates/local_vector.h"
 #include "spmemvfs/spmemvfs.h"
 #include "sqlite/sqlite3.h"
@@ -106,50 +113,220 @@ public:
 };
 
 class SQLiteAccess;
+class SQLiteAsyncResult;
+class SQLiteCursor;
+class SQLiteDatabase;
+
+// Parameter layout of one prepared statement. The parameter count and the
+// binder of each slot are worked out on the first execution and reused until
+// an argument arrives with a different Variant type.
+// Text and blobs are bound SQLITE_STATIC: the plan keeps the UTF-8 encoding
+// and the PackedByteArray of each slot alive until release() is called after
+// the statement was reset.
+// The plan also holds a decoder per result column, picked from its declared
+// type.
+class SQLiteBindPlan {
+public:
+	typedef Variant (*Decoder)(sqlite3_stmt *p_stmt, int p_column);
+
+private:
+	typedef int (*Binder)(SQLiteBindPlan *p_plan, sqlite3_stmt *p_stmt, int p_index, const Variant &p_value);
+
+	int param_count = -1;
+	bool pinned = false;
+	LocalVector<Variant::Type> types;
+	LocalVector<Binder> binders;
+	LocalVector<LocalVector<char>> texts; // Reused UTF-8 scratch buffer per slot.
+	LocalVector<PackedByteArray> blobs;
+	HashMap<String, int> names; // Parameter name, with and without its prefix, to slot.
+	LocalVector<uint8_t> seen;
+	bool names_ready = false;
+	LocalVector<Decoder> decoders;
+	LocalVector<int> storage_classes; // Expected per column, SQLITE_NULL if unknown.
+
+	static Binder get_binder(Variant::Type p_type);
+	static int bind_null(SQLiteBindPlan *p_plan, sqlite3_stmt *p_stmt, int p_index, const Variant &p_value);
+	static int bind_int(SQLiteBindPlan *p_plan, sqlite3_stmt *p_stmt, int p_index, const Variant &p_value);
+	static int bind_float(SQLiteBindPlan *p_plan, sqlite3_stmt *p_stmt, int p_index, const Variant &p_value);
+	static int bind_text(SQLiteBindPlan *p_plan, sqlite3_stmt *p_stmt, int p_index, const Variant &p_value);
+	static int bind_blob(SQLiteBindPlan *p_plan, sqlite3_stmt *p_stmt, int p_index, const Variant &p_value);
+
+	void init(sqlite3_stmt *p_stmt);
+	void init_names(sqlite3_stmt *p_stmt);
+	String bind_array(sqlite3_stmt *p_stmt, const Array &p_args);
+	String bind_dictionary(sqlite3_stmt *p_stmt, const Dictionary &p_args);
+
+public:
+	// p_args is an Array in parameter order, or a Dictionary keyed by
+	// parameter name (":id", "@id", "$id" or just "id").
+	String bind(sqlite3_stmt *p_stmt, const Variant &p_args);
+	void release(sqlite3_stmt *p_stmt);
+
+	// Single slot binding, for callers that do not go through a Variant
+	// argument list. prepare() must have been called once.
+	int prepare(sqlite3_stmt *p_stmt);
+	String bind_slot(sqlite3_stmt *p_stmt, int p_slot, const Variant &p_value);
+	int bind_string(sqlite3_stmt *p_stmt, int p_slot, const String &p_value);
+
+	// Valid while the statement is not re-prepared, so only call it once the
+	// statement has produced a row.
+	const LocalVector<Decoder> &get_decoders(sqlite3_stmt *p_stmt);
+	int get_storage_class(int p_column) const { return p_column < (int)storage_classes.size() ? storage_classes[p_column] : SQLITE_NULL; }
+};
+
+// LRU cache of the idle prepared statements of one connection, keyed by the
+// stripped SQL text. A statement is checked out by exactly one SQLiteQuery at
+// a time and goes back to the cache when the query is finalized. Its bind
+// plan travels with it.
+class SQLiteStatementCache {
+	struct Entry {
+		String sql;
+		sqlite3_stmt *stmt = nullptr;
+		SQLiteBindPlan *plan = nullptr;
+	};
+
+	List<Entry> lru; // Most recently used first.
+	HashMap<String, List<Entry>::Element *> lookup;
+	int capacity = 32;
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+
+	void evict(int p_max_size);
+
+public:
+	int checkout(sqlite3 *p_db, const String &p_sql, sqlite3_stmt **r_stmt, SQLiteBindPlan **r_plan);
+	void checkin(const String &p_sql, sqlite3_stmt *p_stmt, SQLiteBindPlan *p_plan);
+	void clear();
+
+	void set_capacity(int p_capacity);
+	int get_capacity() const { return capacity; }
+	int get_size() const { return lru.size(); }
+	uint64_t get_hits() const { return hits; }
+	uint64_t get_misses() const { return misses; }
+
+	~SQLiteStatementCache() { clear(); }
+};
+
+// A read-only connection of the SQLiteAccess read pool, with its own
+// statement cache. Only used by the thread that acquired it.
+struct SQLiteReader {
+	sqlite3 *handle = nullptr;
+	SQLiteStatementCache statement_cache;
+	bool busy = false;
+};
 
 class SQLiteQueryResult : public RefCounted {
     GDCLASS(SQLiteQueryResult, RefCounted);
     TypedArray<Array> result;
+    Array columns;
+    PackedStringArray column_names;
     Array arguments;
     String query;
     String error;
     int error_code = 0;
+    Dictionary statement_status;
 
 protected:
     static void _bind_methods() {
         ClassDB::bind_method(D_METHOD("get_result"), &SQLiteQueryResult::get_result);
+        ClassDB::bind_method(D_METHOD("get_columns"), &SQLiteQueryResult::get_columns);
+        ClassDB::bind_method(D_METHOD("get_column_names"), &SQLiteQueryResult::get_column_names);
         ClassDB::bind_method(D_METHOD("get_error"), &SQLiteQueryResult::get_error);
         ClassDB::bind_method(D_METHOD("get_error_code"), &SQLiteQueryResult::get_error_code);
         ClassDB::bind_method(D_METHOD("get_query"), &SQLiteQueryResult::get_query);
         ClassDB::bind_method(D_METHOD("get_arguments"), &SQLiteQueryResult::get_arguments);
+        ClassDB::bind_method(D_METHOD("get_statement_status"), &SQLiteQueryResult::get_statement_status);
 
         ADD_PROPERTY(PropertyInfo(Variant::ARRAY, "result", PROPERTY_HINT_ARRAY_TYPE, "Array"), "", "get_result");
+        ADD_PROPERTY(PropertyInfo(Variant::ARRAY, "columns"), "", "get_columns");
+        ADD_PROPERTY(PropertyInfo(Variant::PACKED_STRING_ARRAY, "column_names"), "", "get_column_names");
         ADD_PROPERTY(PropertyInfo(Variant::STRING, "error"), "", "get_error");
         ADD_PROPERTY(PropertyInfo(Variant::INT, "error_code"), "", "get_error_code");
         ADD_PROPERTY(PropertyInfo(Variant::STRING, "query"), "", "get_query");
         ADD_PROPERTY(PropertyInfo(Variant::ARRAY, "arguments"), "", "get_arguments");
+        ADD_PROPERTY(PropertyInfo(Variant::DICTIONARY, "statement_status"), "", "get_statement_status");
     }
 public:
     Array get_arguments() const { return arguments; }
     TypedArray<Array> get_result() const { return result; }
+    Array get_columns() const { return columns; }
+    PackedStringArray get_column_names() const { return column_names; }
     String get_error() const { return error; }
     int get_error_code() const { return error_code; }
     String get_query() const { return query; }
+    Dictionary get_statement_status() const { return statement_status; }
 
     void set_result(TypedArray<Array> p_result) { result = p_result; }
+    void set_columns(Array p_columns) { columns = p_columns; }
+    void set_column_names(PackedStringArray p_column_names) { column_names = p_column_names; }
     void set_error(String p_error) { error = p_error; }
     void set_error_code(int p_error_code) { error_code = p_error_code; }
     void set_query(String p_query) { query = p_query; }
     void set_arguments(Array p_arguments) { arguments = p_arguments; }
+    void set_statement_status(const Dictionary &p_statement_status) { statement_status = p_statement_status; }
+};
+
+class SQLiteBatchResult : public RefCounted {
+    GDCLASS(SQLiteBatchResult, RefCounted);
+    int64_t rows_affected = 0;
+    int64_t last_insert_rowid = 0;
+    int64_t failed_row = -1;
+    int64_t failed_rows = 0;
+    int64_t elapsed_usec = 0;
+    String error;
+    int error_code = 0;
+
+protected:
+    static void _bind_methods() {
+        ClassDB::bind_method(D_METHOD("get_rows_affected"), &SQLiteBatchResult::get_rows_affected);
+        ClassDB::bind_method(D_METHOD("get_last_insert_rowid"), &SQLiteBatchResult::get_last_insert_rowid);
+        ClassDB::bind_method(D_METHOD("get_failed_row"), &SQLiteBatchResult::get_failed_row);
+        ClassDB::bind_method(D_METHOD("get_failed_rows"), &SQLiteBatchResult::get_failed_rows);
+        ClassDB::bind_method(D_METHOD("get_elapsed_usec"), &SQLiteBatchResult::get_elapsed_usec);
+        ClassDB::bind_method(D_METHOD("get_rows_per_second"), &SQLiteBatchResult::get_rows_per_second);
+        ClassDB::bind_method(D_METHOD("get_error"), &SQLiteBatchResult::get_error);
+        ClassDB::bind_method(D_METHOD("get_error_code"), &SQLiteBatchResult::get_error_code);
+
+        ADD_PROPERTY(PropertyInfo(Variant::INT, "rows_affected"), "", "get_rows_affected");
+        ADD_PROPERTY(PropertyInfo(Variant::INT, "last_insert_rowid"), "", "get_last_insert_rowid");
+        ADD_PROPERTY(PropertyInfo(Variant::INT, "failed_row"), "", "get_failed_row");
+        ADD_PROPERTY(PropertyInfo(Variant::INT, "failed_rows"), "", "get_failed_rows");
+        ADD_PROPERTY(PropertyInfo(Variant::INT, "elapsed_usec"), "", "get_elapsed_usec");
+        ADD_PROPERTY(PropertyInfo(Variant::STRING, "error"), "", "get_error");
+        ADD_PROPERTY(PropertyInfo(Variant::INT, "error_code"), "", "get_error_code");
+    }
+public:
+    int64_t get_rows_affected() const { return rows_affected; }
+    int64_t get_last_insert_rowid() const { return last_insert_rowid; }
+    int64_t get_failed_row() const { return failed_row; }
+    int64_t get_failed_rows() const { return failed_rows; }
+    int64_t get_elapsed_usec() const { return elapsed_usec; }
+    double get_rows_per_second() const { return elapsed_usec > 0 ? rows_affected * 1000000.0 / elapsed_usec : 0.0; }
+    String get_error() const { return error; }
+    int get_error_code() const { return error_code; }
+
+    void set_rows_affected(int64_t p_rows_affected) { rows_affected = p_rows_affected; }
+    void set_last_insert_rowid(int64_t p_last_insert_rowid) { last_insert_rowid = p_last_insert_rowid; }
+    void set_failed_row(int64_t p_failed_row) { failed_row = p_failed_row; }
+    void set_failed_rows(int64_t p_failed_rows) { failed_rows = p_failed_rows; }
+    void set_elapsed_usec(int64_t p_elapsed_usec) { elapsed_usec = p_elapsed_usec; }
+    void set_error(String p_error) { error = p_error; }
+    void set_error_code(int p_error_code) { error_code = p_error_code; }
 };
 
 class SQLiteQuery : public RefCounted {
 	GDCLASS(SQLiteQuery, RefCounted);
 
+	friend SQLiteCursor;
+
     Array arguments;
 	SQLiteAccess *db = nullptr;
 	sqlite3_stmt *stmt = nullptr;
+	SQLiteBindPlan *bind_plan = nullptr;
+	SQLiteCursor *cursor = nullptr;
 	String query;
+	String statement_key;
+	bool read_only = false; // Can run on the read pool.
 
 protected:
 	static void _bind_methods();
@@ -165,32 +342,165 @@ public:
     void set_arguments(Array p_arguments) { arguments = p_arguments; }
 	TypedArray<SQLiteColumnSchema> get_columns();
 	void finalize();
-	Ref<SQLiteQueryResult> execute(const Array p_args);
+	Ref<SQLiteQueryResult> execute(const Variant &p_args);
+	Ref<SQLiteQueryResult> execute_columnar(const Variant &p_args);
 	TypedArray<SQLiteQueryResult> batch_execute(TypedArray<Array> p_rows);
+	Ref<SQLiteBatchResult> batch_execute_transaction(TypedArray<Array> p_rows, bool p_savepoint_per_row = false);
+	Ref<SQLiteBatchResult> batch_execute_columns(const Array &p_columns);
+	Ref<SQLiteCursor> open_cursor(const Variant &p_args);
+	Ref<SQLiteAsyncResult> execute_async(const Variant &p_args);
 
 private:
 	bool prepare();
+	Ref<SQLiteQueryResult> run(const Variant &p_args, bool p_columnar);
+	Ref<SQLiteQueryResult> execute_statement(const Variant &p_args, bool p_columnar);
+	int step_statement(sqlite3_stmt *p_stmt, SQLiteBindPlan *p_plan, const Variant &p_args, bool p_columnar, const Ref<SQLiteQueryResult> &r_result);
+	int step_to_end();
+	static void execute_async_task(void *p_userdata);
+};
+
+class SQLiteCursor : public RefCounted {
+	GDCLASS(SQLiteCursor, RefCounted);
+
+	friend SQLiteQuery;
+
+	Ref<SQLiteQuery> query;
+	bool done = false;
+	String error;
+	int error_code = 0;
+
+	bool step(bool &r_has_row);
+
+protected:
+	static void _bind_methods();
+
+public:
+	~SQLiteCursor();
+	TypedArray<Array> fetch(int64_t p_count);
+	Array fetch_columnar(int64_t p_count);
+	PackedStringArray get_column_names() const;
+	bool is_done() const { return done; }
+	String get_error() const { return error; }
+	int get_error_code() const { return error_code; }
+	void close();
+};
+
+class SQLiteAsyncResult : public RefCounted {
+	GDCLASS(SQLiteAsyncResult, RefCounted);
+
+	friend SQLiteQuery;
+
+	Ref<SQLiteQueryResult> result;
+	SafeNumeric<WorkerThreadPool::TaskID> task_id{ WorkerThreadPool::INVALID_TASK_ID };
+	bool completed = false;
+
+	static void deliver(const Ref<SQLiteAsyncResult> &p_handle, const Ref<SQLiteQueryResult> &p_result);
+
+protected:
+	static void _bind_methods();
+
+public:
+	bool is_completed() const { return completed; }
+	Ref<SQLiteQueryResult> get_result() const { return result; }
+};
+
+// Holds SQLiteAccess::mutex for an operation that may run statements on the
+// writer. On unlock it publishes whether the writer is outside a
+// transaction, so the read pool can be chosen without taking the lock.
+class SQLiteWriterLock {
+	SQLiteAccess *access = nullptr;
+
+public:
+	explicit SQLiteWriterLock(SQLiteAccess *p_access);
+	~SQLiteWriterLock();
 };
 
 class SQLiteAccess : public RefCounted {
 	GDCLASS(SQLiteAccess, RefCounted);
 
 	friend SQLiteQuery;
+	friend SQLiteCursor;
+	friend SQLiteDatabase;
+	friend SQLiteWriterLock;
 
 private:
+	// Serializes every use of the connection and of its statements, so that
+	// queries can run on WorkerThreadPool threads. Recursive on purpose.
+	Mutex mutex;
 	sqlite3 *db = nullptr;
 	spmemvfs_db_t spmemvfs_db{};
 	bool memory_read = false;
+	SQLiteStatementCache statement_cache;
+
+	// Read pool. read_pool_lock is held for reading while a reader is in
+	// use and for writing while the pool is opened or closed.
+	LocalVector<SQLiteReader *> readers;
+	mutable RWLock read_pool_lock;
+	mutable BinaryMutex read_pool_mutex;
+	Semaphore read_pool_semaphore;
+	SafeNumeric<uint64_t> read_pool_acquires;
+	SafeNumeric<uint64_t> read_pool_waits;
+	SafeNumeric<uint64_t> read_pool_wait_usec;
+
+	SQLiteReader *acquire_reader();
+	void release_reader(SQLiteReader *p_reader);
+
+	// True while the writer is open and outside a transaction.
+	SafeFlag writer_autocommit;
+	void publish_autocommit();
+
+	// Last value read by get_db_status() for each SQLITE_DBSTATUS_* op.
+	mutable SafeNumeric<int64_t> db_status[SQLITE_DBSTATUS_MAX + 1];
+
+	// Per statement profile collected by sqlite3_trace_v2(), keyed by the
+	// normalized SQL. Histogram bucket i counts runs under 2^(i+1) usec.
+	static const int QUERY_STATS_BUCKETS = 24;
+	struct QueryStats {
+		uint64_t calls = 0;
+		uint64_t total_nsec = 0;
+		uint64_t min_nsec = UINT64_MAX;
+		uint64_t max_nsec = 0;
+		uint64_t histogram[QUERY_STATS_BUCKETS] = {};
+	};
+	bool query_stats_enabled = false;
+	// Fills SQLiteQueryResult.statement_status, read without the lock by
+	// queries running on the read pool.
+	SafeFlag statement_status_enabled;
+	mutable BinaryMutex query_stats_mutex;
+	HashMap<String, QueryStats> query_stats;
+
+	// Options given to open(), applied to the read pool connections too.
+	Dictionary open_options;
+	static bool apply_options(sqlite3 *p_handle, const Dictionary &p_options, bool p_reader = false);
+	bool finish_open(const Dictionary &p_options);
+
+	static int trace_callback(unsigned p_type, void *p_context, void *p_stmt, void *p_nsec);
+	void apply_trace(sqlite3 *p_handle);
+
+	// Slow query log, a ring buffer of the last slow_query_log_size entries.
+	SafeNumeric<uint64_t> slow_query_usec;
+	mutable BinaryMutex slow_queries_mutex;
+	LocalVector<Dictionary> slow_queries;
+	uint32_t slow_queries_next = 0;
+	int slow_query_log_size = 64;
+	String slow_query_log_path;
+
+	String explain_query_plan(const String &p_query);
+	void log_slow_query(const String &p_query, const Variant &p_args, uint64_t p_usec);
 
 	::LocalVector<WeakRef *, uint32_t, true> queries;
+	uint32_t queries_prune_at = 64; // Size at which dead entries are dropped.
 
 	sqlite3_stmt *prepare(const char *statement);
 	Array fetch_rows(const String &query, const Array &args, int result_type = RESULT_BOTH);
 	sqlite3 *get_handler() const { return memory_read ? spmemvfs_db.handle : db; }
+	int exec(const char *p_sql);
+	bool begin_batch(bool &r_nested);
+	bool end_batch(bool p_nested, bool p_commit);
+	int64_t get_schema_version();
 	Dictionary parse_row(sqlite3_stmt *stmt, int result_type);
 
 public:
-	static String bind_args(sqlite3_stmt *stmt, const Array &args);
 
 protected:
 	static void _bind_methods();
@@ -203,14 +513,50 @@ public:
 	SQLiteAccess();
 	~SQLiteAccess();
 
-	bool open(const String &path);
-	bool open_in_memory();
-	bool open_buffered(const String &name, const PackedByteArray &buffers, int64_t size);
+	bool open(const String &path, const Dictionary &p_options = Dictionary());
+	bool open_in_memory(const Dictionary &p_options = Dictionary());
+	bool open_buffered(const String &name, const PackedByteArray &buffers, int64_t size, const Dictionary &p_options = Dictionary());
 	bool backup(const String &path);
 	bool close();
 
+	bool open_read_pool(int p_readers, int p_busy_timeout_msec = 5000);
+	void close_read_pool();
+	int get_read_pool_size() const;
+	Dictionary get_read_pool_stats() const;
+
+	int64_t get_buffered_memory_used() const;
+	int64_t get_buffered_memory_reserved() const;
+
 	Ref<SQLiteQuery> create_query(String p_query, Array p_args = Array());
 
+	void set_statement_cache_capacity(int p_capacity);
+	int get_statement_cache_capacity() const;
+	int get_statement_cache_size() const;
+	int64_t get_statement_cache_hits() const;
+	int64_t get_statement_cache_misses() const;
+	void clear_statement_cache();
+
+	int get_variable_limit() const;
+	int64_t get_db_status(int p_op) const;
+	Dictionary get_lookaside_stats(bool p_reset = false) const;
+	Dictionary get_page_cache_stats(bool p_reset = false) const;
+
+	void set_query_stats_enabled(bool p_enabled);
+	bool is_query_stats_enabled() const;
+	void set_statement_status_enabled(bool p_enabled);
+	bool is_statement_status_enabled() const;
+	Array get_query_stats() const;
+	void reset_query_stats();
+
+	void set_slow_query_threshold_msec(double p_msec);
+	double get_slow_query_threshold_msec() const;
+	void set_slow_query_log_size(int p_size);
+	int get_slow_query_log_size() const;
+	void set_slow_query_log_path(const String &p_path);
+	String get_slow_query_log_path() const;
+	Array get_slow_queries() const;
+	void clear_slow_queries();
+
 	String get_last_error_message() const;
     int get_last_error_code() const;
 };
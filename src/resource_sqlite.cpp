@@ -30,6 +30,10 @@
 
 #include "resource_sqlite.h"
 #include "core/io/file_access.h"
+#include "core/os/os.h"
+
+// Most rows per INSERT statement built by insert_rows_batch().
+static const int64_t MAX_ROWS_PER_INSERT = 64;
 
 void SQLiteDatabase::_bind_methods() {
     ClassDB::bind_method(D_METHOD("get_sqlite"), &SQLiteDatabase::get_sqlite);
@@ -38,8 +42,12 @@ void SQLiteDatabase::_bind_methods() {
     ClassDB::bind_method(D_METHOD("create_query", "query", "arguments"), &SQLiteDatabase::create_query);
     ClassDB::bind_method(D_METHOD("execute_query", "query", "arguments"), &SQLiteDatabase::execute_query);
     ClassDB::bind_method(D_METHOD("get_columns", "table_name"), &SQLiteDatabase::get_columns);
+    ClassDB::bind_method(D_METHOD("get_indexes", "table_name"), &SQLiteDatabase::get_indexes);
+    ClassDB::bind_method(D_METHOD("clear_schema_cache"), &SQLiteDatabase::clear_schema_cache);
     ClassDB::bind_method(D_METHOD("insert_row", "table_name", "value"), &SQLiteDatabase::insert_row);
     ClassDB::bind_method(D_METHOD("insert_rows", "table_name", "values"), &SQLiteDatabase::insert_rows);
+    ClassDB::bind_method(D_METHOD("insert_rows_batch", "table_name", "values"), &SQLiteDatabase::insert_rows_batch);
+    ClassDB::bind_method(D_METHOD("insert_columns", "table_name", "columns"), &SQLiteDatabase::insert_columns);
     ClassDB::bind_method(D_METHOD("delete_rows", "table_name", "condition"), &SQLiteDatabase::delete_rows, DEFVAL(String()));
     ClassDB::bind_method(D_METHOD("select_rows", "table_name", "condition"), &SQLiteDatabase::select_rows, DEFVAL(String()));
     ClassDB::bind_method(D_METHOD("get_tables"), &SQLiteDatabase::get_tables);
@@ -155,63 +163,138 @@ Ref<SQLiteQuery> SQLiteDatabase::drop_table(const String &p_name) {
 }
 
 
-Ref<SQLiteQuery> SQLiteDatabase::insert_row(const String &p_name, const Dictionary &p_row_dict) {
-	String query_string, key_string, value_string = "";
-	Array keys = p_row_dict.keys();
-	Array param_bindings = p_row_dict.values();
-
-	/* Create SQL statement */
-	query_string = "INSERT INTO " + p_name;
-
-	int64_t number_of_keys = p_row_dict.size();
+String SQLiteDatabase::get_insert_template(const String &p_name, const Array &p_keys, int64_t p_rows) {
+	String key_string, value_string = "", values_string = "";
+	int64_t number_of_keys = p_keys.size();
 	for (int64_t i = 0; i < number_of_keys; i++) {
-		key_string += (const String &)keys[i];
+		key_string += (const String &)p_keys[i];
 		value_string += "?";
 		if (i != number_of_keys - 1) {
 			key_string += ",";
 			value_string += ",";
 		}
 	}
-	query_string += " (" + key_string + ") VALUES (" + value_string + ");";
+	for (int64_t i = 0; i < p_rows; i++) {
+		values_string += "(" + value_string + ")";
+		if (i != p_rows - 1) {
+			values_string += ",";
+		}
+	}
+	return "INSERT INTO " + p_name + " (" + key_string + ") VALUES " + values_string + ";";
+}
 
-    return db->create_query(query_string, param_bindings);
+Ref<SQLiteQuery> SQLiteDatabase::insert_row(const String &p_name, const Dictionary &p_row_dict) {
+	return db->create_query(get_insert_template(p_name, p_row_dict.keys(), 1), p_row_dict.values());
 }
 
+// Values of p_rows rows starting at p_first, in the column order of p_keys.
+// Missing values are bound as NULL.
+static Array insert_bindings(const TypedArray<Dictionary> &p_row_array, const Array &p_keys, int64_t p_first, int64_t p_rows) {
+	const int64_t number_of_keys = p_keys.size();
+	Array param_bindings;
+	param_bindings.resize(p_rows * number_of_keys);
+	for (int64_t i = 0; i < p_rows; i++) {
+		Dictionary row = p_row_array[p_first + i];
+		for (int64_t j = 0; j < number_of_keys; j++) {
+			param_bindings[i * number_of_keys + j] = row.get(p_keys[j], Variant());
+		}
+	}
+	return param_bindings;
+}
 
 Ref<SQLiteQuery> SQLiteDatabase::insert_rows(const String &p_name, const TypedArray<Dictionary> &p_row_array) {
-	String query_string, key_string, value_string = "", values_string = "";
-    Dictionary row0 = p_row_array[0];
+	ERR_FAIL_COND_V_MSG(p_row_array.is_empty(), Ref<SQLiteQuery>(), "No rows to insert.");
+	Dictionary row0 = p_row_array[0];
 	Array keys = row0.keys();
-	Array param_bindings;
+	ERR_FAIL_COND_V_MSG(keys.is_empty(), Ref<SQLiteQuery>(), "The rows have no columns.");
 
-	/* Create SQL statement */
-	query_string = "INSERT INTO " + p_name;
+	return db->create_query(get_insert_template(p_name, keys, p_row_array.size()), insert_bindings(p_row_array, keys, 0, p_row_array.size()));
+}
 
-	int64_t number_of_keys = row0.size();
-	for (int64_t i = 0; i < number_of_keys; i++) {
-		key_string += (const String &)keys[i];
-		value_string += "?";
-		if (i != number_of_keys - 1) {
-			key_string += ",";
-			value_string += ",";
-		}
+Ref<SQLiteBatchResult> SQLiteDatabase::insert_rows_batch(const String &p_name, const TypedArray<Dictionary> &p_row_array) {
+	ERR_FAIL_COND_V_MSG(p_row_array.is_empty(), Ref<SQLiteBatchResult>(), "No rows to insert.");
+	Dictionary row0 = p_row_array[0];
+	Array keys = row0.keys();
+	int64_t number_of_keys = keys.size();
+	int64_t number_of_rows = p_row_array.size();
+	ERR_FAIL_COND_V_MSG(number_of_keys == 0, Ref<SQLiteBatchResult>(), "The rows have no columns.");
+
+	Ref<SQLiteBatchResult> result;
+	result.instantiate();
+	const uint64_t start_usec = OS::get_singleton()->get_ticks_usec();
+
+	/* Full chunks share one statement and the remaining rows use a second
+	 * one. The statement cache of the connection keeps both prepared. */
+	const int64_t chunk_rows = MIN(number_of_rows, MIN(MAX_ROWS_PER_INSERT, MAX(db->get_variable_limit() / number_of_keys, (int64_t)1)));
+	const int64_t full_rows = number_of_rows - number_of_rows % chunk_rows;
+	const int64_t statement_rows[2] = { chunk_rows, number_of_rows - full_rows };
+	const int64_t statement_first[2] = { 0, full_rows };
+	TypedArray<Array> statement_params[2];
+	for (int64_t first = 0; first < number_of_rows; first += chunk_rows) {
+		const int s = first < full_rows ? 0 : 1;
+		statement_params[s].push_back(insert_bindings(p_row_array, keys, first, statement_rows[s]));
 	}
-    for (int64_t i = 0; i < p_row_array.size(); i++) {
-        values_string += "(";
-        values_string += value_string;
-        values_string += ")";
-        if (i != p_row_array.size() - 1) {
-            values_string += ",";
-        }
-        Dictionary row = p_row_array[i];
-        Array values = row.values();
-        param_bindings.append_array(values);
-    }
-	query_string += " (" + key_string + ") VALUES " + values_string + ";";
 
-    return db->create_query(query_string, param_bindings);
+	/* All chunks run in a single transaction */
+	SQLiteWriterLock lock(db.ptr());
+	bool nested = false;
+	if (!db->begin_batch(nested)) {
+		result->set_error(db->get_last_error_message());
+		result->set_error_code(db->get_last_error_code());
+		return result;
+	}
+	bool commit = true;
+	for (int s = 0; s < 2 && commit; s++) {
+		if (statement_params[s].is_empty()) {
+			continue;
+		}
+		Ref<SQLiteBatchResult> part = db->create_query(get_insert_template(p_name, keys, statement_rows[s]))->batch_execute_transaction(statement_params[s]);
+		if (part->get_error_code() == SQLITE_OK) {
+			result->set_rows_affected(result->get_rows_affected() + part->get_rows_affected());
+			result->set_last_insert_rowid(part->get_last_insert_rowid());
+			continue;
+		}
+		commit = false;
+		const int64_t failed_chunk_start = statement_first[s] + part->get_failed_row() * statement_rows[s];
+		result->set_failed_row(failed_chunk_start);
+		result->set_failed_rows(1);
+		result->set_error(part->get_error());
+		result->set_error_code(part->get_error_code());
+
+		/* A multi-row INSERT does not tell which of its rows failed. While the
+		 * transaction is still open, replay the chunk one row at a time to
+		 * find it, everything is rolled back below anyway. */
+		if (sqlite3_get_autocommit(db->get_handler()) == 0) {
+			TypedArray<Array> single_rows;
+			for (int64_t i = 0; i < statement_rows[s]; i++) {
+				single_rows.push_back(insert_bindings(p_row_array, keys, failed_chunk_start + i, 1));
+			}
+			Ref<SQLiteBatchResult> single = db->create_query(get_insert_template(p_name, keys, 1))->batch_execute_transaction(single_rows);
+			if (single->get_failed_row() >= 0) {
+				result->set_failed_row(failed_chunk_start + single->get_failed_row());
+				result->set_error(single->get_error());
+				result->set_error_code(single->get_error_code());
+			}
+		}
+	}
+	if (!db->end_batch(nested, commit) && commit) {
+		result->set_error(db->get_last_error_message());
+		result->set_error_code(db->get_last_error_code());
+		commit = false;
+	}
+	if (!commit) {
+		result->set_rows_affected(0);
+	}
+	result->set_elapsed_usec(OS::get_singleton()->get_ticks_usec() - start_usec);
+	return result;
 }
 
+Ref<SQLiteBatchResult> SQLiteDatabase::insert_columns(const String &p_name, const Dictionary &p_columns) {
+	Array keys = p_columns.keys();
+
+	/* One row per execution, the statement cache keeps it prepared */
+	return db->create_query(get_insert_template(p_name, keys, 1))->batch_execute_columns(p_columns.values());
+}
 
 Ref<SQLiteQuery> SQLiteDatabase::select_rows(const String &p_name, const String &p_conditions) {
 	String query_string;
@@ -240,7 +323,92 @@ Ref<SQLiteQuery> SQLiteDatabase::delete_rows(const String &p_name, const String
     return db->create_query(query_string);
 }
 
+void SQLiteDatabase::check_schema_version() const {
+    // Must be called with schema_mutex held. Any DDL, also from another
+    // connection to the same file, bumps the schema version.
+    const int64_t version = db->get_schema_version();
+    if (version != schema_version || version < 0) {
+        schema_version = version;
+        schema_tables_valid = false;
+        schema_tables.clear();
+        schema_columns.clear();
+        schema_indexes.clear();
+    }
+}
+
+void SQLiteDatabase::clear_schema_cache() {
+    MutexLock lock(schema_mutex);
+    schema_version = -1;
+    schema_tables_valid = false;
+    schema_tables.clear();
+    schema_columns.clear();
+    schema_indexes.clear();
+}
+
 TypedArray<SQLiteColumnSchema> SQLiteDatabase::get_columns(const String &p_name) const {
+    MutexLock lock(schema_mutex);
+    check_schema_version();
+    const TypedArray<SQLiteColumnSchema> *cached = schema_columns.getptr(p_name);
+    if (cached != nullptr) {
+        return cached->duplicate();
+    }
+    TypedArray<SQLiteColumnSchema> columns = query_columns(p_name);
+    if (!columns.is_empty()) {
+        schema_columns.insert(p_name, columns);
+    }
+    return columns.duplicate();
+}
+
+TypedArray<Dictionary> SQLiteDatabase::get_indexes(const String &p_name) const {
+    MutexLock lock(schema_mutex);
+    check_schema_version();
+    const TypedArray<Dictionary> *cached = schema_indexes.getptr(p_name);
+    if (cached != nullptr) {
+        return cached->duplicate(true);
+    }
+
+    Ref<SQLiteQuery> query = db->create_query(
+            "SELECT il.name, il.\"unique\", il.origin, il.partial, ii.name "
+            "FROM pragma_index_list(?) AS il JOIN pragma_index_info(il.name) AS ii "
+            "ORDER BY il.seq, ii.seqno");
+    Array args;
+    args.push_back(p_name);
+    Ref<SQLiteQueryResult> result = query->execute(args);
+    if (result->get_error() != "") {
+        ERR_PRINT("Error getting indexes: " + result->get_error() + " " + itos(result->get_error_code()));
+        return TypedArray<Dictionary>();
+    }
+
+    TypedArray<Dictionary> indexes;
+    Dictionary index;
+    PackedStringArray index_columns;
+    Array rows = result->get_result();
+    for (int i = 0; i < rows.size(); i++) {
+        Array row = rows[i];
+        if (index.is_empty() || index["name"] != row[0]) {
+            if (!index.is_empty()) {
+                index["columns"] = index_columns;
+                indexes.append(index);
+            }
+            index = Dictionary();
+            index_columns = PackedStringArray();
+            index["name"] = row[0];
+            index["unique"] = (int64_t)row[1] != 0;
+            index["origin"] = row[2];
+            index["partial"] = (int64_t)row[3] != 0;
+        }
+        index_columns.push_back(row[4]);
+    }
+    if (!index.is_empty()) {
+        index["columns"] = index_columns;
+        indexes.append(index);
+    }
+
+    schema_indexes.insert(p_name, indexes);
+    return indexes.duplicate(true);
+}
+
+TypedArray<SQLiteColumnSchema> SQLiteDatabase::query_columns(const String &p_name) const {
     Ref<SQLiteQuery> query = db->create_query("PRAGMA table_info(" + p_name + ")");
     Ref<SQLiteQueryResult> result = query->execute(Array());
         if (result->get_error() != "") {
@@ -295,29 +463,44 @@ int SQLiteDatabase::get_last_error_code() const {
 }
 
 Dictionary SQLiteDatabase::get_tables() const {
-    Ref<SQLiteQuery> query = db->create_query("SELECT name FROM sqlite_master WHERE type = \"table\"");
+    MutexLock lock(schema_mutex);
+    check_schema_version();
+    if (schema_tables_valid) {
+        return schema_tables.duplicate();
+    }
+
+    // Every table with its columns in a single query.
+    Ref<SQLiteQuery> query = db->create_query(
+            "SELECT m.name, p.name FROM sqlite_master AS m JOIN pragma_table_info(m.name) AS p "
+            "WHERE m.type = 'table' AND m.name NOT LIKE 'sqlite\\_%' ESCAPE '\\' ORDER BY m.name, p.cid");
     Ref<SQLiteQueryResult> result = query->execute(Array());
     if (result->get_error() != "") {
-        ERR_PRINT("Error getting table names: " + result->get_error() + " " + result->get_error_code());
+        ERR_PRINT("Error getting table names: " + result->get_error() + " " + itos(result->get_error_code()));
         return Dictionary();
     }
     Dictionary result_dict;
-    for (int i = 0; i < result->get_result().size(); i++) {
-        Array row = result->get_result()[i];
-        for (int j = 0; j < row.size(); j++) {
-            String name = row[j];
-            if (!name.begins_with("sqlite_")) {
-                TypedArray<SQLiteColumnSchema> columns = get_columns(name);
-                TypedArray<String> column_names;
-                for (int k = 0; k < columns.size(); k++) {
-                    Ref<SQLiteColumnSchema> column = columns[k];
-                    column_names.append(column->get_name());
-                }
-                result_dict[name] = column_names;
+    String table_name;
+    TypedArray<String> column_names;
+    Array rows = result->get_result();
+    for (int i = 0; i < rows.size(); i++) {
+        Array row = rows[i];
+        String name = row[0];
+        if (name != table_name) {
+            if (!table_name.is_empty()) {
+                result_dict[table_name] = column_names;
             }
+            table_name = name;
+            column_names = TypedArray<String>();
         }
+        column_names.append(row[1]);
+    }
+    if (!table_name.is_empty()) {
+        result_dict[table_name] = column_names;
     }
-    return result_dict;
+
+    schema_tables = result_dict;
+    schema_tables_valid = true;
+    return schema_tables.duplicate();
 }
 
 
@@ -32,6 +32,8 @@
 #define SQLITE_RESOURCE_H
 
 #include "core/io/resource.h"
+#include "core/os/mutex.h"
+#include "core/templates/hash_map.h"
 #include "core/variant/variant.h"
 #include "godot_sqlite.h"
 #include "core/variant/typed_array.h"
@@ -40,6 +42,21 @@ class SQLiteDatabase : public Resource {
     GDCLASS(SQLiteDatabase, Resource);
     Ref<SQLiteAccess> db;
 
+    // The SQL text is the statement cache key, so equal tables, columns and
+    // row counts reuse one prepared statement.
+    static String get_insert_template(const String &p_name, const Array &p_keys, int64_t p_rows);
+
+    // Schema metadata, dropped whenever PRAGMA schema_version changes.
+    mutable BinaryMutex schema_mutex;
+    mutable int64_t schema_version = -1;
+    mutable bool schema_tables_valid = false;
+    mutable Dictionary schema_tables;
+    mutable HashMap<String, TypedArray<SQLiteColumnSchema>> schema_columns;
+    mutable HashMap<String, TypedArray<Dictionary>> schema_indexes;
+
+    void check_schema_version() const;
+    TypedArray<SQLiteColumnSchema> query_columns(const String &p_name) const;
+
 protected:
     static void _bind_methods();
 
@@ -51,11 +68,15 @@ public:
 
 	Ref<SQLiteQuery> insert_row(const String &p_name, const Dictionary &p_row_dict);
 	Ref<SQLiteQuery> insert_rows(const String &p_name, const TypedArray<Dictionary> &p_row_array);
+	Ref<SQLiteBatchResult> insert_rows_batch(const String &p_name, const TypedArray<Dictionary> &p_row_array);
+	Ref<SQLiteBatchResult> insert_columns(const String &p_name, const Dictionary &p_columns);
 
 	Ref<SQLiteQuery> select_rows(const String &p_name, const String &p_conditions);
 	Ref<SQLiteQuery> delete_rows(const String &p_name, const String &p_conditions);
     Dictionary get_tables() const;
     TypedArray<SQLiteColumnSchema> get_columns(const String &p_name) const;
+    TypedArray<Dictionary> get_indexes(const String &p_name) const;
+    void clear_schema_cache();
     Ref<SQLiteQuery> create_query(const String &p_query_string, const Array &p_args = Array());
     Ref<SQLiteQueryResult> execute_query(const String &p_query_string, const Array &p_args = Array());
 	String get_last_error_message() const;
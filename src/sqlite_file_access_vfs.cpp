@@ -0,0 +1,331 @@
+/**************************************************************************/
+/*  sqlite_file_access_vfs.cpp                                            */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+
+#include "sqlite_file_access_vfs.h"
+
+#include "core/io/file_access.h"
+#include "core/templates/hash_map.h"
+#include "core/templates/local_vector.h"
+
+// Granularity of the write overlay. Blocks are loaded from the file before
+// they are first written, so any page size works.
+static const int64_t OVERLAY_BLOCK_SIZE = 4096;
+
+struct FileAccessVFSData {
+	Ref<FileAccess> file;
+	// Bytes of the underlying file that are still visible (a truncate hides the rest).
+	int64_t file_length = 0;
+	// Logical size of the database, including the overlay.
+	int64_t size = 0;
+	HashMap<int64_t, PackedByteArray> overlay;
+};
+
+struct FileAccessVFSFile {
+	sqlite3_file base;
+	FileAccessVFSData *data;
+};
+
+// Randomness, sleep and time are delegated to the default VFS.
+static sqlite3_vfs *parent_vfs(sqlite3_vfs *p_vfs) {
+	return (sqlite3_vfs *)p_vfs->pAppData;
+}
+
+// Reads from the underlying file, zero filling what lies past its visible end.
+static void read_file(FileAccessVFSData *p_data, uint8_t *p_buffer, int64_t p_len, int64_t p_offset) {
+	int64_t available = CLAMP(p_data->file_length - p_offset, 0, p_len);
+	if (available > 0) {
+		p_data->file->seek(p_offset);
+		available = p_data->file->get_buffer(p_buffer, available);
+	}
+	if (available < p_len) {
+		memset(p_buffer + available, 0, p_len - available);
+	}
+}
+
+static int file_access_close(sqlite3_file *p_file) {
+	FileAccessVFSFile *file = (FileAccessVFSFile *)p_file;
+	memdelete(file->data);
+	file->data = nullptr;
+	return SQLITE_OK;
+}
+
+static int file_access_read(sqlite3_file *p_file, void *p_buffer, int p_amount, sqlite3_int64 p_offset) {
+	FileAccessVFSData *data = ((FileAccessVFSFile *)p_file)->data;
+	uint8_t *buffer = (uint8_t *)p_buffer;
+	const int64_t available = CLAMP(data->size - p_offset, 0, (int64_t)p_amount);
+
+	if (data->overlay.is_empty()) {
+		read_file(data, buffer, available, p_offset);
+	} else {
+		int64_t done = 0;
+		while (done < available) {
+			const int64_t position = p_offset + done;
+			const int64_t block = position / OVERLAY_BLOCK_SIZE;
+			const int64_t in_block = position % OVERLAY_BLOCK_SIZE;
+			const int64_t chunk = MIN(OVERLAY_BLOCK_SIZE - in_block, available - done);
+			const PackedByteArray *contents = data->overlay.getptr(block);
+			if (contents) {
+				memcpy(buffer + done, contents->ptr() + in_block, chunk);
+			} else {
+				read_file(data, buffer + done, chunk, position);
+			}
+			done += chunk;
+		}
+	}
+
+	if (available < p_amount) {
+		memset(buffer + available, 0, p_amount - available);
+		return SQLITE_IOERR_SHORT_READ;
+	}
+	return SQLITE_OK;
+}
+
+static int file_access_write(sqlite3_file *p_file, const void *p_buffer, int p_amount, sqlite3_int64 p_offset) {
+	FileAccessVFSData *data = ((FileAccessVFSFile *)p_file)->data;
+	const uint8_t *buffer = (const uint8_t *)p_buffer;
+
+	int64_t done = 0;
+	while (done < p_amount) {
+		const int64_t position = p_offset + done;
+		const int64_t block = position / OVERLAY_BLOCK_SIZE;
+		const int64_t in_block = position % OVERLAY_BLOCK_SIZE;
+		const int64_t chunk = MIN(OVERLAY_BLOCK_SIZE - in_block, (int64_t)p_amount - done);
+		PackedByteArray *contents = data->overlay.getptr(block);
+		if (!contents) {
+			PackedByteArray loaded;
+			loaded.resize(OVERLAY_BLOCK_SIZE);
+			read_file(data, loaded.ptrw(), OVERLAY_BLOCK_SIZE, block * OVERLAY_BLOCK_SIZE);
+			contents = &data->overlay.insert(block, loaded)->value;
+		}
+		memcpy(contents->ptrw() + in_block, buffer + done, chunk);
+		done += chunk;
+	}
+
+	data->size = MAX(data->size, (int64_t)p_offset + p_amount);
+	return SQLITE_OK;
+}
+
+static int file_access_truncate(sqlite3_file *p_file, sqlite3_int64 p_size) {
+	FileAccessVFSData *data = ((FileAccessVFSFile *)p_file)->data;
+
+	LocalVector<int64_t> dropped;
+	for (KeyValue<int64_t, PackedByteArray> &E : data->overlay) {
+		const int64_t block_start = E.key * OVERLAY_BLOCK_SIZE;
+		if (block_start >= p_size) {
+			dropped.push_back(E.key);
+		} else if (block_start + OVERLAY_BLOCK_SIZE > p_size) {
+			// Growing the file later must expose zeros, not stale bytes.
+			memset(E.value.ptrw() + (p_size - block_start), 0, block_start + OVERLAY_BLOCK_SIZE - p_size);
+		}
+	}
+	for (const int64_t &block : dropped) {
+		data->overlay.erase(block);
+	}
+
+	data->file_length = MIN(data->file_length, (int64_t)p_size);
+	data->size = p_size;
+	return SQLITE_OK;
+}
+
+static int file_access_sync(sqlite3_file *p_file, int p_flags) {
+	return SQLITE_OK;
+}
+
+static int file_access_file_size(sqlite3_file *p_file, sqlite3_int64 *r_size) {
+	*r_size = ((FileAccessVFSFile *)p_file)->data->size;
+	return SQLITE_OK;
+}
+
+static int file_access_lock(sqlite3_file *p_file, int p_type) {
+	return SQLITE_OK;
+}
+
+static int file_access_unlock(sqlite3_file *p_file, int p_type) {
+	return SQLITE_OK;
+}
+
+static int file_access_check_reserved_lock(sqlite3_file *p_file, int *r_result) {
+	*r_result = 0;
+	return SQLITE_OK;
+}
+
+static int file_access_file_control(sqlite3_file *p_file, int p_op, void *p_arg) {
+	return SQLITE_NOTFOUND;
+}
+
+static int file_access_sector_size(sqlite3_file *p_file) {
+	return 0;
+}
+
+static int file_access_device_characteristics(sqlite3_file *p_file) {
+	return 0;
+}
+
+static const sqlite3_io_methods file_access_io_methods = {
+	1, // iVersion
+	file_access_close,
+	file_access_read,
+	file_access_write,
+	file_access_truncate,
+	file_access_sync,
+	file_access_file_size,
+	file_access_lock,
+	file_access_unlock,
+	file_access_check_reserved_lock,
+	file_access_file_control,
+	file_access_sector_size,
+	file_access_device_characteristics,
+};
+
+static int file_access_vfs_open(sqlite3_vfs *p_vfs, const char *p_path, sqlite3_file *p_file, int p_flags, int *r_out_flags) {
+	FileAccessVFSFile *file = (FileAccessVFSFile *)p_file;
+	file->base.pMethods = nullptr;
+	file->data = nullptr;
+
+	// Journals and temporary files are kept in memory by the connection.
+	if (p_path == nullptr || !(p_flags & SQLITE_OPEN_MAIN_DB)) {
+		return SQLITE_CANTOPEN;
+	}
+
+	Ref<FileAccess> fa = FileAccess::open(String::utf8(p_path), FileAccess::READ);
+	if (fa.is_null()) {
+		return SQLITE_CANTOPEN;
+	}
+
+	file->data = memnew(FileAccessVFSData);
+	file->data->file = fa;
+	file->data->file_length = fa->get_length();
+	file->data->size = file->data->file_length;
+	file->base.pMethods = &file_access_io_methods;
+	if (r_out_flags) {
+		*r_out_flags = p_flags;
+	}
+	return SQLITE_OK;
+}
+
+static int file_access_vfs_delete(sqlite3_vfs *p_vfs, const char *p_path, int p_sync_dir) {
+	return SQLITE_OK;
+}
+
+static int file_access_vfs_access(sqlite3_vfs *p_vfs, const char *p_path, int p_flags, int *r_result) {
+	*r_result = FileAccess::exists(String::utf8(p_path)) ? 1 : 0;
+	return SQLITE_OK;
+}
+
+static int file_access_vfs_full_pathname(sqlite3_vfs *p_vfs, const char *p_path, int p_len, char *r_full_path) {
+	sqlite3_snprintf(p_len, r_full_path, "%s", p_path);
+	return SQLITE_OK;
+}
+
+static void *file_access_vfs_dl_open(sqlite3_vfs *p_vfs, const char *p_path) {
+	return nullptr;
+}
+
+static void file_access_vfs_dl_error(sqlite3_vfs *p_vfs, int p_len, char *r_message) {
+	sqlite3_snprintf(p_len, r_message, "Loadable extensions are not supported");
+}
+
+static void (*file_access_vfs_dl_sym(sqlite3_vfs *p_vfs, void *p_handle, const char *p_symbol))(void) {
+	return nullptr;
+}
+
+static void file_access_vfs_dl_close(sqlite3_vfs *p_vfs, void *p_handle) {
+}
+
+static int file_access_vfs_randomness(sqlite3_vfs *p_vfs, int p_len, char *r_buffer) {
+	return parent_vfs(p_vfs)->xRandomness(parent_vfs(p_vfs), p_len, r_buffer);
+}
+
+static int file_access_vfs_sleep(sqlite3_vfs *p_vfs, int p_microseconds) {
+	return parent_vfs(p_vfs)->xSleep(parent_vfs(p_vfs), p_microseconds);
+}
+
+static int file_access_vfs_current_time(sqlite3_vfs *p_vfs, double *r_time) {
+	return parent_vfs(p_vfs)->xCurrentTime(parent_vfs(p_vfs), r_time);
+}
+
+static int file_access_vfs_get_last_error(sqlite3_vfs *p_vfs, int p_len, char *r_message) {
+	return 0;
+}
+
+static int file_access_vfs_current_time_int64(sqlite3_vfs *p_vfs, sqlite3_int64 *r_time) {
+	sqlite3_vfs *parent = parent_vfs(p_vfs);
+	if (parent->iVersion >= 2 && parent->xCurrentTimeInt64) {
+		return parent->xCurrentTimeInt64(parent, r_time);
+	}
+	double time = 0.0;
+	int result = parent->xCurrentTime(parent, &time);
+	*r_time = (sqlite3_int64)(time * 86400000.0);
+	return result;
+}
+
+static sqlite3_vfs file_access_vfs = {
+	2, // iVersion
+	sizeof(FileAccessVFSFile), // szOsFile
+	1024, // mxPathname
+	nullptr, // pNext
+	SQLITE_FILE_ACCESS_VFS_NAME, // zName
+	nullptr, // pAppData, the default VFS
+	file_access_vfs_open,
+	file_access_vfs_delete,
+	file_access_vfs_access,
+	file_access_vfs_full_pathname,
+	file_access_vfs_dl_open,
+	file_access_vfs_dl_error,
+	file_access_vfs_dl_sym,
+	file_access_vfs_dl_close,
+	file_access_vfs_randomness,
+	file_access_vfs_sleep,
+	file_access_vfs_current_time,
+	file_access_vfs_get_last_error,
+	file_access_vfs_current_time_int64,
+	nullptr, // xSetSystemCall
+	nullptr, // xGetSystemCall
+	nullptr, // xNextSystemCall
+};
+
+int sqlite_file_access_vfs_register() {
+	if (file_access_vfs.pAppData != nullptr) {
+		return SQLITE_OK;
+	}
+	sqlite3_vfs *parent = sqlite3_vfs_find(nullptr);
+	ERR_FAIL_NULL_V_MSG(parent, SQLITE_ERROR, "SQLite has no default VFS.");
+	file_access_vfs.pAppData = parent;
+	return sqlite3_vfs_register(&file_access_vfs, 0);
+}
+
+void sqlite_file_access_vfs_unregister() {
+	if (file_access_vfs.pAppData == nullptr) {
+		return;
+	}
+	sqlite3_vfs_unregister(&file_access_vfs);
+	file_access_vfs.pAppData = nullptr;
+}
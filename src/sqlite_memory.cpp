@@ -0,0 +1,151 @@
+/**************************************************************************/
+/*  sqlite_memory.cpp                                                     */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+
+#include "sqlite_memory.h"
+#include "sqlite_statistics.h"
+
+#include "core/config/project_settings.h"
+#include "core/os/memory.h"
+#include "sqlite/sqlite3.h"
+
+// Every block starts with its size, SQLite needs it for xSize. 16 bytes keep
+// the returned pointer as aligned as the one from the allocator.
+static const size_t HEADER_SIZE = 16;
+
+static void *heap_arena = nullptr;
+static void *page_cache_arena = nullptr;
+
+static void *memory_malloc(int p_size) {
+	uint8_t *block = (uint8_t *)Memory::alloc_static(p_size + HEADER_SIZE);
+	if (block == nullptr) {
+		return nullptr;
+	}
+	*(uint64_t *)block = p_size;
+	return block + HEADER_SIZE;
+}
+
+static void memory_free(void *p_ptr) {
+	uint8_t *block = (uint8_t *)p_ptr - HEADER_SIZE;
+	Memory::free_static(block);
+}
+
+static void *memory_realloc(void *p_ptr, int p_size) {
+	uint8_t *block = (uint8_t *)p_ptr - HEADER_SIZE;
+	block = (uint8_t *)Memory::realloc_static(block, p_size + HEADER_SIZE);
+	if (block == nullptr) {
+		return nullptr;
+	}
+	*(uint64_t *)block = p_size;
+	return block + HEADER_SIZE;
+}
+
+static int memory_size(void *p_ptr) {
+	return p_ptr != nullptr ? *(uint64_t *)((uint8_t *)p_ptr - HEADER_SIZE) : 0;
+}
+
+static int memory_roundup(int p_size) {
+	return (p_size + 7) & ~7;
+}
+
+static int memory_init(void *p_app_data) {
+	return SQLITE_OK;
+}
+
+static void memory_shutdown(void *p_app_data) {
+}
+
+static const sqlite3_mem_methods godot_mem_methods = {
+	memory_malloc,
+	memory_free,
+	memory_realloc,
+	memory_size,
+	memory_roundup,
+	memory_init,
+	memory_shutdown,
+	nullptr, // pAppData
+};
+
+int sqlite_memory_configure() {
+	const int64_t heap_arena_mb = GLOBAL_DEF_RST(PropertyInfo(Variant::INT, "sqlite/memory/heap_arena_size_mb", PROPERTY_HINT_RANGE, "0,1024,1,or_greater"), 0);
+	const int64_t page_cache_mb = GLOBAL_DEF_RST(PropertyInfo(Variant::INT, "sqlite/memory/page_cache_size_mb", PROPERTY_HINT_RANGE, "0,1024,1,or_greater"), 0);
+
+	int err = SQLITE_OK;
+	if (heap_arena_mb > 0) {
+		// memsys5 serves every allocation from the arena, the malloc methods
+		// are not used. Allocations fail once it is full.
+		const size_t size = heap_arena_mb * 1024 * 1024;
+		heap_arena = Memory::alloc_static(size);
+		ERR_FAIL_NULL_V_MSG(heap_arena, SQLITE_NOMEM, "Cannot reserve the SQLite heap arena.");
+		err = sqlite3_config(SQLITE_CONFIG_HEAP, heap_arena, (int)size, 64);
+		if (err != SQLITE_OK) {
+			Memory::free_static(heap_arena);
+			heap_arena = nullptr;
+			ERR_PRINT("SQLite was built without SQLITE_ENABLE_MEMSYS5, the heap arena is ignored.");
+		}
+	}
+	if (heap_arena == nullptr) {
+		err = sqlite3_config(SQLITE_CONFIG_MALLOC, &godot_mem_methods);
+		// SQLite was already initialized by someone else, keep its allocator.
+		ERR_FAIL_COND_V_MSG(err != SQLITE_OK, err, "Cannot route SQLite allocations through Godot's Memory.");
+	}
+
+	if (page_cache_mb > 0) {
+		// Slots fit the default 4096 byte pages plus the cache header. Pages
+		// that do not fit, or arrive once the arena is full, use the heap.
+		int header_size = 0;
+		sqlite3_config(SQLITE_CONFIG_PCACHE_HDRSZ, &header_size);
+		const int slot_size = 4096 + header_size;
+		const int slots = page_cache_mb * 1024 * 1024 / slot_size;
+		page_cache_arena = Memory::alloc_static((size_t)slot_size * slots);
+		ERR_FAIL_NULL_V_MSG(page_cache_arena, SQLITE_NOMEM, "Cannot reserve the SQLite page cache arena.");
+		if (sqlite3_config(SQLITE_CONFIG_PAGECACHE, page_cache_arena, slot_size, slots) != SQLITE_OK) {
+			Memory::free_static(page_cache_arena);
+			page_cache_arena = nullptr;
+			ERR_PRINT("Cannot configure the SQLite page cache arena.");
+		}
+	}
+	return sqlite3_initialize();
+}
+
+void sqlite_memory_shutdown() {
+	// Connections still open keep pointers into the arenas, leave SQLite and
+	// its memory to the process exit.
+	ERR_FAIL_COND_MSG(SQLiteStatistics::has_connections(), "SQLite connections are still open at exit, SQLite is not shut down.");
+	sqlite3_shutdown();
+	if (heap_arena != nullptr) {
+		Memory::free_static(heap_arena);
+		heap_arena = nullptr;
+	}
+	if (page_cache_arena != nullptr) {
+		Memory::free_static(page_cache_arena);
+		page_cache_arena = nullptr;
+	}
+}
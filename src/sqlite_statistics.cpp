@@ -0,0 +1,211 @@
+/**************************************************************************/
+/*  sqlite_statistics.cpp                                                 */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+
+#include "sqlite_statistics.h"
+
+#include "core/object/callable_method_pointer.h"
+#include "core/os/os.h"
+#include "main/performance.h"
+
+#include "godot_sqlite.h"
+
+SafeNumeric<uint64_t> SQLiteStatistics::queries;
+SafeNumeric<uint64_t> SQLiteStatistics::rows;
+SafeNumeric<uint64_t> SQLiteStatistics::execute_usec;
+SafeNumeric<uint64_t> SQLiteStatistics::latency[LATENCY_BUCKETS];
+
+BinaryMutex SQLiteStatistics::connections_mutex;
+LocalVector<SQLiteAccess *> SQLiteStatistics::connections;
+
+BinaryMutex SQLiteStatistics::samples_mutex;
+SQLiteStatistics::Sample SQLiteStatistics::queries_sample;
+SQLiteStatistics::Sample SQLiteStatistics::rows_sample;
+uint64_t SQLiteStatistics::average_queries = 0;
+uint64_t SQLiteStatistics::average_usec = 0;
+uint64_t SQLiteStatistics::percentile_latency[LATENCY_BUCKETS] = {};
+
+void SQLiteStatistics::record_query(uint64_t p_usec) {
+	queries.increment();
+	execute_usec.add(p_usec);
+	int bucket = 0;
+	while (bucket < LATENCY_BUCKETS - 1 && (p_usec >> (bucket + 1)) != 0) {
+		bucket++;
+	}
+	latency[bucket].increment();
+}
+
+void SQLiteStatistics::add_connection(SQLiteAccess *p_access) {
+	MutexLock lock(connections_mutex);
+	connections.push_back(p_access);
+}
+
+void SQLiteStatistics::remove_connection(SQLiteAccess *p_access) {
+	MutexLock lock(connections_mutex);
+	connections.erase(p_access);
+}
+
+bool SQLiteStatistics::has_connections() {
+	MutexLock lock(connections_mutex);
+	return !connections.is_empty();
+}
+
+double SQLiteStatistics::rate(Sample &r_sample, uint64_t p_value) {
+	// Average since the previous sample, the monitors are polled about once
+	// per second.
+	const uint64_t now = OS::get_singleton()->get_ticks_usec();
+	const uint64_t elapsed = now - r_sample.ticks_usec;
+	const double result = r_sample.ticks_usec > 0 && elapsed > 0 ? (p_value - r_sample.value) * 1000000.0 / elapsed : 0.0;
+	r_sample.value = p_value;
+	r_sample.ticks_usec = now;
+	return result;
+}
+
+double SQLiteStatistics::get_queries_per_second() {
+	MutexLock lock(samples_mutex);
+	return rate(queries_sample, queries.get());
+}
+
+double SQLiteStatistics::get_rows_per_second() {
+	MutexLock lock(samples_mutex);
+	return rate(rows_sample, rows.get());
+}
+
+double SQLiteStatistics::get_average_execute_msec() {
+	MutexLock lock(samples_mutex);
+	const uint64_t total_queries = queries.get();
+	const uint64_t total_usec = execute_usec.get();
+	const uint64_t count = total_queries - average_queries;
+	const double result = count > 0 ? (total_usec - average_usec) / 1000.0 / count : 0.0;
+	average_queries = total_queries;
+	average_usec = total_usec;
+	return result;
+}
+
+double SQLiteStatistics::get_p99_execute_msec() {
+	MutexLock lock(samples_mutex);
+	uint64_t counts[LATENCY_BUCKETS];
+	uint64_t total = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		const uint64_t value = latency[i].get();
+		counts[i] = value - percentile_latency[i];
+		percentile_latency[i] = value;
+		total += counts[i];
+	}
+	if (total == 0) {
+		return 0.0;
+	}
+
+	// Upper bound of the bucket holding the 99th percentile.
+	const uint64_t target = total - total / 100;
+	uint64_t seen = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		seen += counts[i];
+		if (seen >= target) {
+			return (double)(uint64_t(1) << (i + 1)) / 1000.0;
+		}
+	}
+	return (double)(uint64_t(1) << LATENCY_BUCKETS) / 1000.0;
+}
+
+double SQLiteStatistics::get_statement_cache_hit_rate() {
+	MutexLock lock(connections_mutex);
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	for (const SQLiteAccess *access : connections) {
+		hits += access->get_statement_cache_hits();
+		misses += access->get_statement_cache_misses();
+	}
+	return hits + misses > 0 ? (double)hits / (hits + misses) : 0.0;
+}
+
+int64_t SQLiteStatistics::sum_db_status(int p_op) {
+	MutexLock lock(connections_mutex);
+	int64_t total = 0;
+	for (const SQLiteAccess *access : connections) {
+		total += access->get_db_status(p_op);
+	}
+	return total;
+}
+
+int64_t SQLiteStatistics::get_cache_used() {
+	return sum_db_status(SQLITE_DBSTATUS_CACHE_USED);
+}
+
+int64_t SQLiteStatistics::get_cache_hits() {
+	return sum_db_status(SQLITE_DBSTATUS_CACHE_HIT);
+}
+
+int64_t SQLiteStatistics::get_cache_misses() {
+	return sum_db_status(SQLITE_DBSTATUS_CACHE_MISS);
+}
+
+int64_t SQLiteStatistics::get_statement_memory() {
+	return sum_db_status(SQLITE_DBSTATUS_STMT_USED);
+}
+
+int64_t SQLiteStatistics::get_schema_memory() {
+	return sum_db_status(SQLITE_DBSTATUS_SCHEMA_USED);
+}
+
+int64_t SQLiteStatistics::get_heap_used() {
+	// Whole library, whichever allocator or arena is configured.
+	return sqlite3_memory_used();
+}
+
+void SQLiteStatistics::register_monitors() {
+	Performance *performance = Performance::get_singleton();
+	if (performance == nullptr) {
+		return;
+	}
+
+	struct Monitor {
+		const char *id;
+		Callable callable;
+	};
+	const Monitor monitors[] = {
+		{ "SQLite/Queries per second", callable_mp_static(&SQLiteStatistics::get_queries_per_second) },
+		{ "SQLite/Rows decoded per second", callable_mp_static(&SQLiteStatistics::get_rows_per_second) },
+		{ "SQLite/Execute average (ms)", callable_mp_static(&SQLiteStatistics::get_average_execute_msec) },
+		{ "SQLite/Execute p99 (ms)", callable_mp_static(&SQLiteStatistics::get_p99_execute_msec) },
+		{ "SQLite/Statement cache hit rate", callable_mp_static(&SQLiteStatistics::get_statement_cache_hit_rate) },
+		{ "SQLite/Page cache used (bytes)", callable_mp_static(&SQLiteStatistics::get_cache_used) },
+		{ "SQLite/Page cache hits", callable_mp_static(&SQLiteStatistics::get_cache_hits) },
+		{ "SQLite/Page cache misses", callable_mp_static(&SQLiteStatistics::get_cache_misses) },
+		{ "SQLite/Statement memory (bytes)", callable_mp_static(&SQLiteStatistics::get_statement_memory) },
+		{ "SQLite/Schema memory (bytes)", callable_mp_static(&SQLiteStatistics::get_schema_memory) },
+		{ "SQLite/Heap used (bytes)", callable_mp_static(&SQLiteStatistics::get_heap_used) },
+	};
+	for (const Monitor &monitor : monitors) {
+		if (!performance->has_custom_monitor(monitor.id)) {
+			performance->add_custom_monitor(monitor.id, monitor.callable, Vector<Variant>());
+		}
+	}
+}
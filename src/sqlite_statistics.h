@@ -0,0 +1,95 @@
+/**************************************************************************/
+/*  sqlite_statistics.h                                                   */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+
+#ifndef SQLITE_STATISTICS_H
+#define SQLITE_STATISTICS_H
+
+#include "core/os/mutex.h"
+#include "core/templates/local_vector.h"
+#include "core/templates/safe_refcount.h"
+
+class SQLiteAccess;
+
+// Module wide counters behind the "SQLite/..." Performance monitors. Queries
+// record themselves here, and the per-connection values are summed over every
+// live SQLiteAccess when a monitor is sampled.
+class SQLiteStatistics {
+	// Execute latency histogram, bucket i counts queries that took less than
+	// 2^(i+1) microseconds.
+	static const int LATENCY_BUCKETS = 32;
+
+	static SafeNumeric<uint64_t> queries;
+	static SafeNumeric<uint64_t> rows;
+	static SafeNumeric<uint64_t> execute_usec;
+	static SafeNumeric<uint64_t> latency[LATENCY_BUCKETS];
+
+	static BinaryMutex connections_mutex;
+	static LocalVector<SQLiteAccess *> connections;
+
+	// Totals at the previous sample of each rate monitor.
+	struct Sample {
+		uint64_t value = 0;
+		uint64_t ticks_usec = 0;
+	};
+	static BinaryMutex samples_mutex;
+	static Sample queries_sample;
+	static Sample rows_sample;
+	static uint64_t average_queries;
+	static uint64_t average_usec;
+	static uint64_t percentile_latency[LATENCY_BUCKETS];
+
+	static double rate(Sample &r_sample, uint64_t p_value);
+	static int64_t sum_db_status(int p_op);
+
+public:
+	static void record_query(uint64_t p_usec);
+	static void record_rows(uint64_t p_rows) { rows.add(p_rows); }
+
+	static void add_connection(SQLiteAccess *p_access);
+	static void remove_connection(SQLiteAccess *p_access);
+	static bool has_connections();
+
+	static double get_queries_per_second();
+	static double get_rows_per_second();
+	static double get_average_execute_msec();
+	static double get_p99_execute_msec();
+	static double get_statement_cache_hit_rate();
+	static int64_t get_cache_used();
+	static int64_t get_cache_hits();
+	static int64_t get_cache_misses();
+	static int64_t get_statement_memory();
+	static int64_t get_schema_memory();
+	static int64_t get_heap_used();
+
+	static void register_monitors();
+};
+
+#endif // SQLITE_STATISTICS_H
@@ -0,0 +1,437 @@
+/**************************************************************************/
+/*  test_sqlite.h                                                         */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef TEST_SQLITE_H
+#define TEST_SQLITE_H
+
+#include "core/io/dir_access.h"
+#include "core/io/file_access.h"
+#include "core/object/message_queue.h"
+#include "core/os/os.h"
+
+#include "../src/godot_sqlite.h"
+#include "../src/resource_sqlite.h"
+
+#include "tests/test_macros.h"
+#include "tests/test_utils.h"
+
+namespace TestSQLite {
+
+static Ref<SQLiteAccess> open_file(const String &p_name) {
+	const String path = TestUtils::get_temp_path(p_name);
+	DirAccess::remove_absolute(path);
+	Ref<SQLiteAccess> access;
+	access.instantiate();
+	REQUIRE(access->open(path));
+	return access;
+}
+
+static void execute(const Ref<SQLiteAccess> &p_access, const String &p_query, const Array &p_args = Array()) {
+	Ref<SQLiteQueryResult> result = p_access->create_query(p_query)->execute(p_args);
+	REQUIRE_MESSAGE(result->get_error_code() == SQLITE_OK, result->get_error());
+}
+
+static Ref<SQLiteAccess> open_memory() {
+	Ref<SQLiteAccess> access;
+	access.instantiate();
+	REQUIRE(access->open_in_memory());
+	return access;
+}
+
+static void fill_items(const Ref<SQLiteAccess> &p_access, int64_t p_rows) {
+	execute(p_access, "CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT, weight REAL)");
+	Ref<SQLiteQuery> insert = p_access->create_query("INSERT INTO items (id, name, weight) VALUES (?, ?, ?)");
+	for (int64_t i = 1; i <= p_rows; i++) {
+		Array args;
+		args.push_back(i);
+		args.push_back(vformat("item_%d", i));
+		args.push_back(i * 0.5);
+		REQUIRE(insert->execute(args)->get_error_code() == SQLITE_OK);
+	}
+}
+
+static int64_t count_rows(const Ref<SQLiteAccess> &p_access, const String &p_table) {
+	Ref<SQLiteQueryResult> result = p_access->create_query("SELECT COUNT(*) FROM " + p_table)->execute(Array());
+	return result->get_result().is_empty() ? -1 : (int64_t)Array(result->get_result()[0])[0];
+}
+
+TEST_CASE("[SQLite] Transaction control stays on the writer with a read pool open") {
+	Ref<SQLiteAccess> access = open_file("sqlite_test_read_pool.db");
+	execute(access, "CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT)");
+	REQUIRE(access->open_read_pool(2));
+
+	Ref<SQLiteQuery> begin = access->create_query("BEGIN");
+	Ref<SQLiteQuery> insert = access->create_query("INSERT INTO items (name) VALUES (?)");
+	Ref<SQLiteQuery> rollback = access->create_query("ROLLBACK");
+	Array args;
+	args.push_back("sword");
+	// The second round reuses prepared statements, the first one that could
+	// be routed to a reader.
+	for (int round = 0; round < 2; round++) {
+		CHECK(begin->execute(Array())->get_error_code() == SQLITE_OK);
+		CHECK(insert->execute(args)->get_error_code() == SQLITE_OK);
+		CHECK(rollback->execute(Array())->get_error_code() == SQLITE_OK);
+		CHECK(count_rows(access, "items") == 0);
+	}
+
+	// Still possible to write, so no reader is left holding a lock.
+	execute(access, "INSERT INTO items (name) VALUES ('shield')");
+	CHECK(count_rows(access, "items") == 1);
+	access->close();
+}
+
+TEST_CASE("[SQLite] insert_rows and insert_rows_batch") {
+	Ref<SQLiteDatabase> database;
+	database.instantiate();
+	database->execute_query("CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT)");
+
+	TypedArray<Dictionary> rows;
+	for (int64_t i = 1; i <= 150; i++) {
+		Dictionary row;
+		row["id"] = i;
+		row["name"] = vformat("item_%d", i);
+		rows.push_back(row);
+	}
+
+	SUBCASE("insert_rows returns a query") {
+		TypedArray<Dictionary> first_rows = rows.slice(0, 10);
+		Ref<SQLiteQuery> query = database->insert_rows("items", first_rows);
+		REQUIRE(query.is_valid());
+		CHECK(query->execute(Array())->get_error_code() == SQLITE_OK);
+		CHECK(count_rows(database->get_sqlite(), "items") == 10);
+	}
+
+	SUBCASE("insert_rows_batch inserts full chunks and the remaining rows") {
+		Ref<SQLiteBatchResult> result = database->insert_rows_batch("items", rows);
+		CHECK(result->get_error_code() == SQLITE_OK);
+		CHECK(result->get_rows_affected() == 150);
+		CHECK(result->get_last_insert_rowid() == 150);
+		CHECK(count_rows(database->get_sqlite(), "items") == 150);
+	}
+
+	SUBCASE("insert_rows_batch reports the row that failed") {
+		Dictionary duplicate = rows[130];
+		duplicate["id"] = 5;
+		rows[130] = duplicate;
+		Ref<SQLiteBatchResult> result = database->insert_rows_batch("items", rows);
+		CHECK(result->get_error_code() != SQLITE_OK);
+		CHECK(result->get_failed_row() == 130);
+		CHECK(result->get_rows_affected() == 0);
+		CHECK(count_rows(database->get_sqlite(), "items") == 0);
+	}
+}
+
+TEST_CASE("[SQLite] Statement cache reuses prepared statements") {
+	Ref<SQLiteAccess> access = open_memory();
+	fill_items(access, 3);
+	access->clear_statement_cache();
+	CHECK(access->get_statement_cache_size() == 0);
+
+	const int64_t misses = access->get_statement_cache_misses();
+	CHECK(count_rows(access, "items") == 3);
+	CHECK(access->get_statement_cache_misses() == misses + 1);
+	// The query above was freed, its statement went back to the cache.
+	CHECK(access->get_statement_cache_size() == 1);
+
+	const int64_t hits = access->get_statement_cache_hits();
+	Ref<SQLiteQueryResult> result = access->create_query("  SELECT COUNT(*) FROM items  ")->execute(Array());
+	CHECK(result->get_error_code() == SQLITE_OK);
+	CHECK(access->get_statement_cache_hits() == hits + 1);
+
+	access->set_statement_cache_capacity(0);
+	CHECK(access->get_statement_cache_size() == 0);
+	CHECK(count_rows(access, "items") == 3);
+	CHECK(access->get_statement_cache_size() == 0);
+}
+
+TEST_CASE("[SQLite] Binding round-trips text, numbers and blobs") {
+	Ref<SQLiteAccess> access = open_memory();
+	execute(access, "CREATE TABLE data (t TEXT, i INTEGER, f REAL, b BLOB)");
+
+	const String text = String::utf8("h\xc3\xa9llo \xe4\xb8\x96\xe7\x95\x8c \xf0\x9f\x8c\x8d");
+	PackedByteArray blob;
+	blob.push_back(0);
+	blob.push_back(255);
+	Array args;
+	args.push_back(text);
+	args.push_back((int64_t)1 << 40);
+	args.push_back(2.5);
+	args.push_back(blob);
+	Ref<SQLiteQuery> insert = access->create_query("INSERT INTO data VALUES (?, ?, ?, ?)");
+	CHECK(insert->execute(args)->get_error_code() == SQLITE_OK);
+	// Second run reuses the bind plan and the scratch buffers.
+	CHECK(insert->execute(args)->get_error_code() == SQLITE_OK);
+
+	Ref<SQLiteQueryResult> result = access->create_query("SELECT t, i, f, b, length(CAST(t AS BLOB)) FROM data")->execute(Array());
+	REQUIRE(result->get_result().size() == 2);
+	Array row = result->get_result()[1];
+	CHECK(String(row[0]) == text);
+	CHECK((int64_t)row[1] == (int64_t)1 << 40);
+	CHECK((double)row[2] == doctest::Approx(2.5));
+	CHECK(PackedByteArray(row[3]) == blob);
+	CHECK((int64_t)row[4] == text.utf8().length());
+
+	Dictionary named;
+	named[":t"] = "named";
+	named["i"] = 7;
+	Ref<SQLiteQueryResult> named_result = access->create_query("SELECT :t, @i")->execute(named);
+	REQUIRE(named_result->get_result().size() == 1);
+	CHECK(String(Array(named_result->get_result()[0])[0]) == "named");
+	CHECK((int64_t)Array(named_result->get_result()[0])[1] == 7);
+}
+
+TEST_CASE("[SQLite] Columnar results and column batches") {
+	Ref<SQLiteAccess> access = open_memory();
+	execute(access, "CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT, weight REAL)");
+
+	PackedInt64Array ids;
+	PackedStringArray names;
+	PackedFloat64Array weights;
+	for (int64_t i = 1; i <= 100; i++) {
+		ids.push_back(i);
+		names.push_back(vformat("item_%d", i));
+		weights.push_back(i * 0.5);
+	}
+	Array columns;
+	columns.push_back(ids);
+	columns.push_back(names);
+	columns.push_back(weights);
+	Ref<SQLiteBatchResult> batch = access->create_query("INSERT INTO items (id, name, weight) VALUES (?, ?, ?)")->batch_execute_columns(columns);
+	CHECK(batch->get_error_code() == SQLITE_OK);
+	CHECK(batch->get_rows_affected() == 100);
+	CHECK(batch->get_last_insert_rowid() == 100);
+
+	Ref<SQLiteQueryResult> result = access->create_query("SELECT id, name, weight FROM items ORDER BY id")->execute_columnar(Array());
+	CHECK(result->get_error_code() == SQLITE_OK);
+	CHECK(result->get_column_names() == PackedStringArray({ "id", "name", "weight" }));
+	Array result_columns = result->get_columns();
+	REQUIRE(result_columns.size() == 3);
+	REQUIRE(result_columns[0].get_type() == Variant::PACKED_INT64_ARRAY);
+	REQUIRE(result_columns[1].get_type() == Variant::PACKED_STRING_ARRAY);
+	REQUIRE(result_columns[2].get_type() == Variant::PACKED_FLOAT64_ARRAY);
+	CHECK(PackedInt64Array(result_columns[0]) == ids);
+	CHECK(PackedStringArray(result_columns[1]) == names);
+	CHECK(PackedFloat64Array(result_columns[2]) == weights);
+
+	SUBCASE("A failed row rolls the whole batch back") {
+		Array duplicate;
+		duplicate.push_back(PackedInt64Array({ 101, 102, 5 }));
+		duplicate.push_back(PackedStringArray({ "a", "b", "c" }));
+		duplicate.push_back(PackedFloat64Array({ 1.0, 2.0, 3.0 }));
+		Ref<SQLiteBatchResult> failed = access->create_query("INSERT INTO items (id, name, weight) VALUES (?, ?, ?)")->batch_execute_columns(duplicate);
+		CHECK(failed->get_error_code() != SQLITE_OK);
+		CHECK(failed->get_failed_row() == 2);
+		CHECK(failed->get_rows_affected() == 0);
+		CHECK(count_rows(access, "items") == 100);
+	}
+}
+
+TEST_CASE("[SQLite] Cursors fetch rows in pages") {
+	Ref<SQLiteAccess> access = open_memory();
+	fill_items(access, 10);
+
+	Ref<SQLiteQuery> query = access->create_query("SELECT id, name FROM items ORDER BY id");
+	Ref<SQLiteCursor> cursor = query->open_cursor(Array());
+	REQUIRE(cursor.is_valid());
+	CHECK(cursor->get_column_names() == PackedStringArray({ "id", "name" }));
+
+	TypedArray<Array> page = cursor->fetch(4);
+	REQUIRE(page.size() == 4);
+	CHECK((int64_t)Array(page[0])[0] == 1);
+	CHECK_FALSE(cursor->is_done());
+
+	// The statement belongs to the cursor until it is closed.
+	CHECK(query->execute(Array())->get_error_code() == SQLITE_MISUSE);
+
+	Array columns = cursor->fetch_columnar(4);
+	REQUIRE(columns.size() == 2);
+	CHECK(PackedInt64Array(columns[0]) == PackedInt64Array({ 5, 6, 7, 8 }));
+
+	page = cursor->fetch(4);
+	CHECK(page.size() == 2);
+	CHECK(cursor->is_done());
+	CHECK(cursor->get_error_code() == SQLITE_OK);
+
+	cursor->close();
+	CHECK(query->execute(Array())->get_result().size() == 10);
+}
+
+TEST_CASE("[SQLite] Read pool runs reads on reader connections") {
+	Ref<SQLiteAccess> access = open_file("sqlite_test_read_pool_reads.db");
+	fill_items(access, 5);
+	REQUIRE(access->open_read_pool(2));
+	CHECK(access->get_read_pool_size() == 2);
+
+	Ref<SQLiteQuery> count = access->create_query("SELECT COUNT(*) FROM items");
+	// The first run finds out that the statement only reads.
+	CHECK((int64_t)Array(count->execute(Array())->get_result()[0])[0] == 5);
+	const int64_t acquires = access->get_read_pool_stats()["acquires"];
+	CHECK((int64_t)Array(count->execute(Array())->get_result()[0])[0] == 5);
+	CHECK((int64_t)access->get_read_pool_stats()["acquires"] == acquires + 1);
+
+	// Inside a transaction reads stay on the writer and see its changes.
+	execute(access, "BEGIN");
+	execute(access, "INSERT INTO items (name) VALUES ('pending')");
+	CHECK((int64_t)Array(count->execute(Array())->get_result()[0])[0] == 6);
+	CHECK((int64_t)access->get_read_pool_stats()["acquires"] == acquires + 1);
+	execute(access, "ROLLBACK");
+	CHECK((int64_t)Array(count->execute(Array())->get_result()[0])[0] == 5);
+
+	access->close_read_pool();
+	CHECK(access->get_read_pool_size() == 0);
+	access->close();
+}
+
+TEST_CASE("[SQLite] Read pool is refused where readers cannot work") {
+	Ref<SQLiteAccess> access = open_memory();
+	ERR_PRINT_OFF;
+	CHECK_FALSE(access->open_read_pool(2));
+	ERR_PRINT_ON;
+
+	const String path = TestUtils::get_temp_path("sqlite_test_exclusive.db");
+	DirAccess::remove_absolute(path);
+	Ref<SQLiteAccess> exclusive;
+	exclusive.instantiate();
+	Dictionary options;
+	options["locking_mode"] = "EXCLUSIVE";
+	REQUIRE(exclusive->open(path, options));
+	ERR_PRINT_OFF;
+	CHECK_FALSE(exclusive->open_read_pool(2));
+	ERR_PRINT_ON;
+	exclusive->close();
+}
+
+TEST_CASE("[SQLite] execute_async delivers the result on the main thread") {
+	Ref<SQLiteAccess> access = open_memory();
+	fill_items(access, 3);
+
+	Ref<SQLiteAsyncResult> handle = access->create_query("SELECT COUNT(*) FROM items")->execute_async(Array());
+	REQUIRE(handle.is_valid());
+	const uint64_t deadline = OS::get_singleton()->get_ticks_msec() + 5000;
+	while (!handle->is_completed() && OS::get_singleton()->get_ticks_msec() < deadline) {
+		MessageQueue::get_singleton()->flush();
+		OS::get_singleton()->delay_usec(1000);
+	}
+	REQUIRE(handle->is_completed());
+	Ref<SQLiteQueryResult> result = handle->get_result();
+	CHECK(result->get_error_code() == SQLITE_OK);
+	CHECK((int64_t)Array(result->get_result()[0])[0] == 3);
+}
+
+TEST_CASE("[SQLite] Schema cache follows schema changes") {
+	Ref<SQLiteDatabase> database;
+	database.instantiate();
+	database->execute_query("CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT)");
+
+	CHECK(database->get_tables().has("items"));
+	CHECK(database->get_columns("items").size() == 2);
+	// Served from the cache, the schema did not change.
+	CHECK(database->get_columns("items").size() == 2);
+	CHECK(database->get_indexes("items").is_empty());
+
+	database->execute_query("ALTER TABLE items ADD COLUMN weight REAL");
+	database->execute_query("CREATE INDEX items_name ON items (name)");
+	CHECK(database->get_columns("items").size() == 3);
+	CHECK(database->get_indexes("items").size() == 1);
+	CHECK(Array(database->get_tables()["items"]).size() == 3);
+
+	database->execute_query("DROP TABLE items");
+	CHECK_FALSE(database->get_tables().has("items"));
+}
+
+TEST_CASE("[SQLite] Buffered databases") {
+	const String path = TestUtils::get_temp_path("sqlite_test_buffered.db");
+	DirAccess::remove_absolute(path);
+	{
+		Ref<SQLiteAccess> access;
+		access.instantiate();
+		REQUIRE(access->open(path));
+		execute(access, "CREATE TABLE blobs (id INTEGER PRIMARY KEY, data BLOB)");
+		PackedByteArray blob;
+		blob.resize(4096);
+		blob.fill(7);
+		Ref<SQLiteQuery> insert = access->create_query("INSERT INTO blobs (data) VALUES (?)");
+		for (int i = 0; i < 500; i++) {
+			Array args;
+			args.push_back(blob);
+			REQUIRE(insert->execute(args)->get_error_code() == SQLITE_OK);
+		}
+		access->close();
+	}
+	const PackedByteArray data = FileAccess::get_file_as_bytes(path);
+	REQUIRE(data.size() > 500 * 4096);
+
+	Ref<SQLiteAccess> access;
+	access.instantiate();
+	REQUIRE(access->open_buffered("sqlite_test_buffered", data, data.size()));
+	CHECK(access->get_buffered_memory_used() == data.size());
+
+	SUBCASE("Reads through mmap and shrinks on truncate") {
+		execute(access, "PRAGMA mmap_size=268435456");
+		Ref<SQLiteQueryResult> sum = access->create_query("SELECT COUNT(*), SUM(length(data)) FROM blobs")->execute(Array());
+		REQUIRE(sum->get_result().size() == 1);
+		CHECK((int64_t)Array(sum->get_result()[0])[0] == 500);
+		CHECK((int64_t)Array(sum->get_result()[0])[1] == 500 * 4096);
+
+		execute(access, "DELETE FROM blobs WHERE id > 10");
+		execute(access, "VACUUM");
+		CHECK(count_rows(access, "blobs") == 10);
+		CHECK(access->get_buffered_memory_used() < data.size());
+		CHECK(access->get_buffered_memory_reserved() >= access->get_buffered_memory_used());
+	}
+
+	SUBCASE("Databases with the same name keep their own buffer") {
+		Ref<SQLiteAccess> other;
+		other.instantiate();
+		REQUIRE(other->open_buffered("sqlite_test_buffered", data, data.size()));
+		execute(other, "DELETE FROM blobs");
+		CHECK(count_rows(other, "blobs") == 0);
+		CHECK(count_rows(access, "blobs") == 500);
+		other->close();
+		CHECK(count_rows(access, "blobs") == 500);
+	}
+
+	SUBCASE("Open flags are refused") {
+		Ref<SQLiteAccess> other;
+		other.instantiate();
+		Dictionary options;
+		options["read_only"] = true;
+		ERR_PRINT_OFF;
+		CHECK_FALSE(other->open_buffered("sqlite_test_read_only", data, data.size(), options));
+		ERR_PRINT_ON;
+	}
+
+	access->close();
+	DirAccess::remove_absolute(path);
+}
+
+} // namespace TestSQLite
+
+#endif // TEST_SQLITE_H
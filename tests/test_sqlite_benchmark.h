@@ -0,0 +1,353 @@
+/**************************************************************************/
+/*  test_sqlite_benchmark.h                                               */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+
+#ifndef TEST_SQLITE_BENCHMARK_H
+#define TEST_SQLITE_BENCHMARK_H
+
+#include "core/config/engine.h"
+#include "core/io/dir_access.h"
+#include "core/io/file_access.h"
+#include "core/io/json.h"
+#include "core/math/random_pcg.h"
+#include "core/os/os.h"
+
+#include "../src/godot_sqlite.h"
+#include "../src/resource_sqlite.h"
+
+#include "tests/test_macros.h"
+#include "tests/test_utils.h"
+
+// Skipped by default, run with:
+//   godot --headless --test --test-case="*[Benchmark]*" --no-skip
+// SQLITE_BENCHMARK_MAX_ROWS sets the largest table (default 100000, up to
+// 10000000), SQLITE_BENCHMARK_OUTPUT a file to write the JSON report to.
+
+namespace TestSQLiteBenchmark {
+
+// APIs that take one Dictionary or Array per row are capped at this many
+// rows, the larger tables are filled column-wise.
+const int64_t ROW_API_LIMIT = 100000;
+const int64_t SINGLE_ROW_LIMIT = 10000;
+const int64_t POINT_SELECTS = 10000;
+const int64_t RANGE_SIZE = 1000;
+const int64_t BLOB_COUNT = 1000;
+const int64_t BLOB_SIZE = 4096;
+
+class BenchmarkReport {
+	Array results;
+	uint64_t begin_usec = 0;
+
+public:
+	void begin() {
+		begin_usec = OS::get_singleton()->get_ticks_usec();
+	}
+
+	void end(const String &p_name, int64_t p_table_rows, int64_t p_rows) {
+		const uint64_t usec = OS::get_singleton()->get_ticks_usec() - begin_usec;
+		Dictionary result;
+		result["name"] = p_name;
+		result["table_rows"] = p_table_rows;
+		result["rows"] = p_rows;
+		result["usec"] = usec;
+		result["rows_per_second"] = usec > 0 ? p_rows * 1000000.0 / usec : 0.0;
+		results.push_back(result);
+	}
+
+	String to_json() const {
+		Dictionary report;
+		report["engine_version"] = Engine::get_singleton()->get_version_info()["string"];
+		report["sqlite_version"] = String(sqlite3_libversion());
+		report["results"] = results;
+		return JSON::stringify(report, "\t");
+	}
+};
+
+static Ref<SQLiteDatabase> create_database() {
+	Ref<SQLiteDatabase> database;
+	database.instantiate();
+	database->execute_query("CREATE TABLE bench (id INTEGER PRIMARY KEY, name TEXT, score REAL, level INTEGER)");
+	return database;
+}
+
+static Dictionary make_row(int64_t p_id) {
+	Dictionary row;
+	row["id"] = p_id;
+	row["name"] = vformat("player_%d", p_id);
+	row["score"] = p_id * 0.5;
+	row["level"] = p_id % 100;
+	return row;
+}
+
+static Array make_args(int64_t p_id) {
+	Array args;
+	args.push_back(p_id);
+	args.push_back(vformat("player_%d", p_id));
+	args.push_back(p_id * 0.5);
+	args.push_back(p_id % 100);
+	return args;
+}
+
+static Dictionary make_columns(int64_t p_first, int64_t p_count) {
+	PackedInt64Array ids;
+	PackedStringArray names;
+	PackedFloat64Array scores;
+	PackedInt64Array levels;
+	ids.resize(p_count);
+	names.resize(p_count);
+	scores.resize(p_count);
+	levels.resize(p_count);
+	for (int64_t i = 0; i < p_count; i++) {
+		const int64_t id = p_first + i;
+		ids.set(i, id);
+		names.set(i, vformat("player_%d", id));
+		scores.set(i, id * 0.5);
+		levels.set(i, id % 100);
+	}
+
+	Dictionary columns;
+	columns["id"] = ids;
+	columns["name"] = names;
+	columns["score"] = scores;
+	columns["level"] = levels;
+	return columns;
+}
+
+// Fills the table in slices to keep the packed arrays small.
+static void fill_table(const Ref<SQLiteDatabase> &p_database, int64_t p_rows) {
+	const int64_t SLICE = 1000000;
+	for (int64_t first = 0; first < p_rows; first += SLICE) {
+		p_database->insert_columns("bench", make_columns(first + 1, MIN(SLICE, p_rows - first)));
+	}
+}
+
+static int64_t count_rows(const Ref<SQLiteAccess> &p_access) {
+	Ref<SQLiteQueryResult> result = p_access->create_query("SELECT COUNT(*) FROM bench")->execute(Array());
+	return result->get_result().is_empty() ? -1 : (int64_t)Array(result->get_result()[0])[0];
+}
+
+static void benchmark_inserts(BenchmarkReport &r_report, int64_t p_rows) {
+	{
+		const int64_t rows = MIN(p_rows, SINGLE_ROW_LIMIT);
+		Ref<SQLiteDatabase> database = create_database();
+		database->execute_query("BEGIN");
+		r_report.begin();
+		for (int64_t i = 1; i <= rows; i++) {
+			database->insert_row("bench", make_row(i))->execute(Array());
+		}
+		r_report.end("insert_row", p_rows, rows);
+		database->execute_query("COMMIT");
+		CHECK(count_rows(database->get_sqlite()) == rows);
+	}
+	{
+		const int64_t rows = MIN(p_rows, ROW_API_LIMIT);
+		Ref<SQLiteDatabase> database = create_database();
+		TypedArray<Dictionary> values;
+		for (int64_t i = 1; i <= rows; i++) {
+			values.push_back(make_row(i));
+		}
+		r_report.begin();
+		database->insert_rows_batch("bench", values);
+		r_report.end("insert_rows_batch", p_rows, rows);
+		CHECK(count_rows(database->get_sqlite()) == rows);
+	}
+	{
+		const int64_t rows = MIN(p_rows, SINGLE_ROW_LIMIT);
+		Ref<SQLiteDatabase> database = create_database();
+		TypedArray<Array> values;
+		for (int64_t i = 1; i <= rows; i++) {
+			values.push_back(make_args(i));
+		}
+		Ref<SQLiteQuery> query = database->create_query("INSERT INTO bench (id, name, score, level) VALUES (?, ?, ?, ?)");
+		database->execute_query("BEGIN");
+		r_report.begin();
+		query->batch_execute(values);
+		r_report.end("batch_execute", p_rows, rows);
+		database->execute_query("COMMIT");
+		CHECK(count_rows(database->get_sqlite()) == rows);
+	}
+	{
+		const int64_t rows = MIN(p_rows, ROW_API_LIMIT);
+		Ref<SQLiteDatabase> database = create_database();
+		TypedArray<Array> values;
+		for (int64_t i = 1; i <= rows; i++) {
+			values.push_back(make_args(i));
+		}
+		Ref<SQLiteQuery> query = database->create_query("INSERT INTO bench (id, name, score, level) VALUES (?, ?, ?, ?)");
+		r_report.begin();
+		query->batch_execute_transaction(values);
+		r_report.end("batch_execute_transaction", p_rows, rows);
+		CHECK(count_rows(database->get_sqlite()) == rows);
+	}
+	{
+		Ref<SQLiteDatabase> database = create_database();
+		r_report.begin();
+		fill_table(database, p_rows);
+		r_report.end("insert_columns", p_rows, p_rows);
+		CHECK(count_rows(database->get_sqlite()) == p_rows);
+	}
+}
+
+static void benchmark_selects(BenchmarkReport &r_report, int64_t p_rows) {
+	Ref<SQLiteDatabase> database = create_database();
+	fill_table(database, p_rows);
+	RandomPCG rng(p_rows);
+
+	Ref<SQLiteQuery> point = database->create_query("SELECT * FROM bench WHERE id = ?");
+	r_report.begin();
+	for (int64_t i = 0; i < POINT_SELECTS; i++) {
+		Array args;
+		args.push_back(1 + (int64_t)rng.rand(p_rows));
+		point->execute(args);
+	}
+	r_report.end("point_select", p_rows, POINT_SELECTS);
+
+	const int64_t range = MIN(RANGE_SIZE, p_rows);
+	const int64_t ranges = MAX((int64_t)1, MIN(p_rows, ROW_API_LIMIT) / range);
+	Ref<SQLiteQuery> range_query = database->create_query("SELECT * FROM bench WHERE id BETWEEN ? AND ?");
+	for (int columnar = 0; columnar < 2; columnar++) {
+		int64_t rows = 0;
+		r_report.begin();
+		for (int64_t i = 0; i < ranges; i++) {
+			const int64_t first = 1 + (int64_t)rng.rand(p_rows - range + 1);
+			Array args;
+			args.push_back(first);
+			args.push_back(first + range - 1);
+			if (columnar) {
+				Ref<SQLiteQueryResult> result = range_query->execute_columnar(args);
+				rows += result->get_columns().is_empty() ? 0 : PackedInt64Array(result->get_columns()[0]).size();
+			} else {
+				rows += range_query->execute(args)->get_result().size();
+			}
+		}
+		r_report.end(columnar ? "range_select_columnar" : "range_select", p_rows, rows);
+		CHECK(rows == ranges * range);
+	}
+}
+
+static void benchmark_blobs(BenchmarkReport &r_report) {
+	Ref<SQLiteAccess> access;
+	access.instantiate();
+	REQUIRE(access->open_in_memory());
+	access->create_query("CREATE TABLE blobs (id INTEGER PRIMARY KEY, data BLOB)")->execute(Array());
+
+	PackedByteArray blob;
+	blob.resize(BLOB_SIZE);
+	for (int64_t i = 0; i < BLOB_SIZE; i++) {
+		blob.set(i, i & 0xff);
+	}
+
+	TypedArray<Array> values;
+	for (int64_t i = 1; i <= BLOB_COUNT; i++) {
+		Array args;
+		args.push_back(i);
+		args.push_back(blob);
+		values.push_back(args);
+	}
+	r_report.begin();
+	access->create_query("INSERT INTO blobs (id, data) VALUES (?, ?)")->batch_execute_transaction(values);
+	r_report.end("blob_write", BLOB_COUNT, BLOB_COUNT);
+
+	r_report.begin();
+	Ref<SQLiteQueryResult> result = access->create_query("SELECT data FROM blobs")->execute(Array());
+	r_report.end("blob_read", BLOB_COUNT, BLOB_COUNT);
+
+	REQUIRE(result->get_result().size() == BLOB_COUNT);
+	CHECK(PackedByteArray(Array(result->get_result()[BLOB_COUNT - 1])[0]) == blob);
+}
+
+static void benchmark_startup(BenchmarkReport &r_report, int64_t p_rows) {
+	const String path = TestUtils::get_temp_path("sqlite_benchmark.db");
+	DirAccess::remove_absolute(path);
+	{
+		Ref<SQLiteAccess> access;
+		access.instantiate();
+		REQUIRE(access->open(path));
+		access->create_query("CREATE TABLE bench (id INTEGER PRIMARY KEY, name TEXT, score REAL, level INTEGER)")->execute(Array());
+		const int64_t SLICE = 1000000;
+		for (int64_t first = 0; first < p_rows; first += SLICE) {
+			const Dictionary columns = make_columns(first + 1, MIN(SLICE, p_rows - first));
+			access->create_query("INSERT INTO bench (id, name, score, level) VALUES (?, ?, ?, ?)")->batch_execute_columns(columns.values());
+		}
+		access->close();
+	}
+
+	// Opening includes the first query, which reads the schema.
+	{
+		r_report.begin();
+		Ref<SQLiteAccess> access;
+		access.instantiate();
+		REQUIRE(access->open(path));
+		const int64_t rows = count_rows(access);
+		r_report.end("open", p_rows, 1);
+		CHECK(rows == p_rows);
+	}
+	{
+		r_report.begin();
+		const PackedByteArray data = FileAccess::get_file_as_bytes(path);
+		Ref<SQLiteAccess> access;
+		access.instantiate();
+		REQUIRE(access->open_buffered("sqlite_benchmark", data, data.size()));
+		const int64_t rows = count_rows(access);
+		r_report.end("open_buffered", p_rows, 1);
+		CHECK(rows == p_rows);
+	}
+	DirAccess::remove_absolute(path);
+}
+
+TEST_CASE("[SQLite][Benchmark] Inserts, selects, blobs and startup" * doctest::skip()) {
+	int64_t max_rows = 100000;
+	const String max_rows_env = OS::get_singleton()->get_environment("SQLITE_BENCHMARK_MAX_ROWS");
+	if (max_rows_env.is_valid_int()) {
+		max_rows = CLAMP(max_rows_env.to_int(), (int64_t)1000, (int64_t)10000000);
+	}
+
+	BenchmarkReport report;
+	for (int64_t rows = 1000; rows <= max_rows; rows *= 10) {
+		benchmark_inserts(report, rows);
+		benchmark_selects(report, rows);
+		benchmark_startup(report, rows);
+	}
+	benchmark_blobs(report);
+
+	const String json = report.to_json();
+	print_line(json);
+
+	const String output = OS::get_singleton()->get_environment("SQLITE_BENCHMARK_OUTPUT");
+	if (!output.is_empty()) {
+		Ref<FileAccess> file = FileAccess::open(output, FileAccess::WRITE);
+		REQUIRE(file.is_valid());
+		file->store_string(json);
+	}
+}
+
+} // namespace TestSQLiteBenchmark
+
+#endif // TEST_SQLITE_BENCHMARK_H
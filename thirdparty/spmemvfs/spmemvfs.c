@@ -60,11 +60,112 @@ static void spmemvfsDebug(const char *format, ...){
 
 //===========================================================================
 
+#define SPMEMBUFFER_CHUNK_INDEX(offset) ((offset)/SPMEMBUFFER_CHUNK_SIZE)
+#define SPMEMBUFFER_CHUNK_OFFSET(offset) ((offset)%SPMEMBUFFER_CHUNK_SIZE)
+
+static char * spmembufferChunk( spmembuffer_t * mem, int64_t index )
+{
+	if( index >= mem->nchunks ) {
+		/* Only the page table grows geometrically, stored chunks stay put. */
+		int64_t newCount = SPMEMVFS_MAX( 2 * mem->nchunks, index + 1 );
+		char ** newChunks = (char**)realloc( mem->chunks, newCount * sizeof( char * ) );
+
+		if( NULL == newChunks ) return NULL;
+
+		memset( newChunks + mem->nchunks, 0, ( newCount - mem->nchunks ) * sizeof( char * ) );
+		mem->chunks = newChunks;
+		mem->nchunks = newCount;
+	}
+
+	if( NULL == mem->chunks[ index ] ) {
+		mem->chunks[ index ] = (char*)calloc( SPMEMBUFFER_CHUNK_SIZE, 1 );
+		if( NULL == mem->chunks[ index ] ) return NULL;
+		mem->total += SPMEMBUFFER_CHUNK_SIZE;
+	}
+
+	return mem->chunks[ index ];
+}
+
+static void spmembufferShrink( spmembuffer_t * mem, int64_t size )
+{
+	int64_t keep = ( size + SPMEMBUFFER_CHUNK_SIZE - 1 ) / SPMEMBUFFER_CHUNK_SIZE;
+	int64_t i = 0;
+
+	for( i = keep; i < mem->nchunks; i++ ) {
+		if( NULL != mem->chunks[ i ] ) {
+			free( mem->chunks[ i ] );
+			mem->chunks[ i ] = NULL;
+			mem->total -= SPMEMBUFFER_CHUNK_SIZE;
+		}
+	}
+
+	/* Zero the tail of the last chunk so a later extension reads zeros. */
+	if( keep > 0 && keep <= mem->nchunks && NULL != mem->chunks[ keep - 1 ]
+			&& SPMEMBUFFER_CHUNK_OFFSET( size ) != 0 ) {
+		int64_t tail = SPMEMBUFFER_CHUNK_OFFSET( size );
+		memset( mem->chunks[ keep - 1 ] + tail, 0, SPMEMBUFFER_CHUNK_SIZE - tail );
+	}
+
+	if( keep < mem->nchunks / 2 ) {
+		char ** newChunks = NULL;
+		int64_t newCount = SPMEMVFS_MAX( keep, 1 );
+
+		newChunks = (char**)realloc( mem->chunks, newCount * sizeof( char * ) );
+		if( NULL != newChunks ) {
+			mem->chunks = newChunks;
+			mem->nchunks = newCount;
+		}
+	}
+}
+
+spmembuffer_t * spmembuffer_create( const void * data, int64_t size )
+{
+	spmembuffer_t * mem = (spmembuffer_t*)calloc( sizeof( spmembuffer_t ), 1 );
+	int64_t offset = 0;
+
+	if( NULL == mem ) return NULL;
+
+	while( offset < size ) {
+		int64_t len = SPMEMVFS_MIN( size - offset, (int64_t)SPMEMBUFFER_CHUNK_SIZE );
+		char * chunk = spmembufferChunk( mem, SPMEMBUFFER_CHUNK_INDEX( offset ) );
+
+		if( NULL == chunk ) {
+			spmembuffer_free( mem );
+			return NULL;
+		}
+
+		if( NULL != data ) memcpy( chunk, (const char*)data + offset, len );
+		offset += len;
+	}
+
+	mem->used = size;
+
+	return mem;
+}
+
+void spmembuffer_free( spmembuffer_t * mem )
+{
+	int64_t i = 0;
+
+	if( NULL == mem ) return;
+
+	for( i = 0; i < mem->nchunks; i++ ) {
+		free( mem->chunks[ i ] );
+	}
+
+	free( mem->chunks );
+	free( mem );
+}
+
+//===========================================================================
+
 typedef struct spmemfile_t {
 	sqlite3_file base;
 	char * path;
 	int flags;
 	spmembuffer_t * mem;
+	sqlite3_int64 mmapSize;       /* PRAGMA mmap_size limit for xFetch */
+	int mmapRefs;                 /* pages handed out by xFetch */
 } spmemfile_t;
 
 static int spmemfileClose( sqlite3_file * file );
@@ -79,9 +180,11 @@ static int spmemfileCheckReservedLock( sqlite3_file * file, int * result );
 static int spmemfileFileControl( sqlite3_file * file, int op, void * arg );
 static int spmemfileSectorSize( sqlite3_file * file );
 static int spmemfileDeviceCharacteristics( sqlite3_file * file );
+static int spmemfileFetch( sqlite3_file * file, sqlite3_int64 offset, int len, void ** pp );
+static int spmemfileUnfetch( sqlite3_file * file, sqlite3_int64 offset, void * p );
 
 static sqlite3_io_methods g_spmemfile_io_memthods = {
-	1,                                  /* iVersion */
+	3,                                  /* iVersion */
 	spmemfileClose,                     /* xClose */
 	spmemfileRead,                      /* xRead */
 	spmemfileWrite,                     /* xWrite */
@@ -93,7 +196,13 @@ static sqlite3_io_methods g_spmemfile_io_memthods = {
 	spmemfileCheckReservedLock,         /* xCheckReservedLock */
 	spmemfileFileControl,               /* xFileControl */
 	spmemfileSectorSize,                /* xSectorSize */
-	spmemfileDeviceCharacteristics      /* xDeviceCharacteristics */
+	spmemfileDeviceCharacteristics,     /* xDeviceCharacteristics */
+	0,                                  /* xShmMap */
+	0,                                  /* xShmLock */
+	0,                                  /* xShmBarrier */
+	0,                                  /* xShmUnmap */
+	spmemfileFetch,                     /* xFetch */
+	spmemfileUnfetch                    /* xUnfetch */
 };
 
 int spmemfileClose( sqlite3_file * file )
@@ -105,10 +214,7 @@ int spmemfileClose( sqlite3_file * file )
 	if( SQLITE_OPEN_MAIN_DB & memfile->flags ) {
 		// noop
 	} else {
-		if( NULL != memfile->mem ) {
-			if( memfile->mem->data ) free( memfile->mem->data );
-			free( memfile->mem );
-		}
+		spmembuffer_free( memfile->mem );
 	}
 
 	free( memfile->path );
@@ -119,15 +225,31 @@ int spmemfileClose( sqlite3_file * file )
 int spmemfileRead( sqlite3_file * file, void * buffer, int len, sqlite3_int64 offset )
 {
 	spmemfile_t * memfile = (spmemfile_t*)file;
+	spmembuffer_t * mem = memfile->mem;
+	char * out = (char*)buffer;
 
 	spmemvfsDebug( "call %s( %p, ..., %d, %lld ), len %d",
-		__func__, memfile, len, offset, memfile->mem->used );
+		__func__, memfile, len, offset, mem->used );
 
-	if( ( offset + len ) > memfile->mem->used ) {
+	if( ( offset + len ) > mem->used ) {
 		return SQLITE_IOERR_SHORT_READ;
 	}
 
-	memcpy( buffer, memfile->mem->data + offset, len );
+	while( len > 0 ) {
+		int64_t index = SPMEMBUFFER_CHUNK_INDEX( offset );
+		int64_t start = SPMEMBUFFER_CHUNK_OFFSET( offset );
+		int part = (int)SPMEMVFS_MIN( (int64_t)len, SPMEMBUFFER_CHUNK_SIZE - start );
+
+		if( index < mem->nchunks && NULL != mem->chunks[ index ] ) {
+			memcpy( out, mem->chunks[ index ] + start, part );
+		} else {
+			memset( out, 0, part );
+		}
+
+		out += part;
+		offset += part;
+		len -= part;
+	}
 
 	return SQLITE_OK;
 }
@@ -140,20 +262,26 @@ int spmemfileWrite( sqlite3_file * file, const void * buffer, int len, sqlite3_i
 	spmemvfsDebug( "call %s( %p, ..., %d, %lld ), len %d",
 		__func__, memfile, len, offset, mem->used );
 
-	if( ( offset + len ) > mem->total ) {
-		int64_t newTotal = 2 * ( offset + len + mem->total );
-		char * newBuffer = (char*)realloc( mem->data, newTotal );
-		if( NULL == newBuffer ) {
-			return SQLITE_NOMEM;
+	const char * in = (const char*)buffer;
+	sqlite3_int64 end = offset + len;
+
+	while( len > 0 ) {
+		int64_t start = SPMEMBUFFER_CHUNK_OFFSET( offset );
+		int part = (int)SPMEMVFS_MIN( (int64_t)len, SPMEMBUFFER_CHUNK_SIZE - start );
+		char * chunk = spmembufferChunk( mem, SPMEMBUFFER_CHUNK_INDEX( offset ) );
+
+		if( NULL == chunk ) {
+			return SQLITE_IOERR_NOMEM;
 		}
 
-		mem->total = newTotal;
-		mem->data = newBuffer;
-	}
+		memcpy( chunk + start, in, part );
 
-	memcpy( mem->data + offset, buffer, len );
+		in += part;
+		offset += part;
+		len -= part;
+	}
 
-	mem->used = SPMEMVFS_MAX( mem->used, offset + len );
+	mem->used = SPMEMVFS_MAX( mem->used, end );
 
 	return SQLITE_OK;
 }
@@ -166,6 +294,12 @@ int spmemfileTruncate( sqlite3_file * file, sqlite3_int64 size )
 
 	memfile->mem->used = SPMEMVFS_MIN( memfile->mem->used, size );
 
+	/* Pages handed out by xFetch must stay valid, the chunks past the end
+	 * are released by a later truncate instead. */
+	if( 0 == memfile->mmapRefs ) {
+		spmembufferShrink( memfile->mem, memfile->mem->used );
+	}
+
 	return SQLITE_OK;
 }
 
@@ -212,9 +346,21 @@ int spmemfileCheckReservedLock( sqlite3_file * file, int * result )
 
 int spmemfileFileControl( sqlite3_file * file, int op, void * arg )
 {
-	spmemvfsDebug( "call %s( %p )", __func__, file );
+	spmemfile_t * memfile = (spmemfile_t*)file;
 
-	return SQLITE_OK;
+	spmemvfsDebug( "call %s( %p, %d )", __func__, file, op );
+
+	if( SQLITE_FCNTL_MMAP_SIZE == op ) {
+		sqlite3_int64 * size = (sqlite3_int64*)arg;
+		if( *size >= 0 ) {
+			memfile->mmapSize = *size;
+		}
+		*size = memfile->mmapSize;
+		return SQLITE_OK;
+	}
+
+	/* Anything else, including PRAGMAs, is left to SQLite. */
+	return SQLITE_NOTFOUND;
 }
 
 int spmemfileSectorSize( sqlite3_file * file )
@@ -231,6 +377,43 @@ int spmemfileDeviceCharacteristics( sqlite3_file * file )
 	return 0;
 }
 
+int spmemfileFetch( sqlite3_file * file, sqlite3_int64 offset, int len, void ** pp )
+{
+	spmemfile_t * memfile = (spmemfile_t*)file;
+
+	spmemvfsDebug( "call %s( %p, %lld, %d )", __func__, memfile, offset, len );
+
+	*pp = NULL;
+
+	/* Only the part of the database within PRAGMA mmap_size is mapped and
+	 * only when the page does not straddle two chunks, everything else goes
+	 * through xRead. */
+	if( ( offset + len ) <= memfile->mmapSize && ( offset + len ) <= memfile->mem->used
+			&& SPMEMBUFFER_CHUNK_OFFSET( offset ) + len <= SPMEMBUFFER_CHUNK_SIZE ) {
+		int64_t index = SPMEMBUFFER_CHUNK_INDEX( offset );
+
+		if( index < memfile->mem->nchunks && NULL != memfile->mem->chunks[ index ] ) {
+			*pp = memfile->mem->chunks[ index ] + SPMEMBUFFER_CHUNK_OFFSET( offset );
+			memfile->mmapRefs++;
+		}
+	}
+
+	return SQLITE_OK;
+}
+
+int spmemfileUnfetch( sqlite3_file * file, sqlite3_int64 offset, void * p )
+{
+	spmemfile_t * memfile = (spmemfile_t*)file;
+
+	spmemvfsDebug( "call %s( %p, %lld, %p )", __func__, memfile, offset, p );
+
+	if( NULL != p && memfile->mmapRefs > 0 ) {
+		memfile->mmapRefs--;
+	}
+
+	return SQLITE_OK;
+}
+
 //===========================================================================
 
 typedef struct spmemvfs_cb_t {
@@ -384,47 +567,109 @@ int spmemvfs_init( spmemvfs_cb_t * cb )
 
 typedef struct spmembuffer_link_t {
 	char * path;
+	uint32_t hash;
 	spmembuffer_t * mem;
 	struct spmembuffer_link_t * next;
 } spmembuffer_link_t;
 
-spmembuffer_link_t * spmembuffer_link_remove( spmembuffer_link_t ** head, const char * path )
+static uint32_t spmembuffer_hash( const char * path )
 {
-	spmembuffer_link_t * ret = NULL;
-
-	spmembuffer_link_t ** iter = head;
-	for( ; NULL != *iter; ) {
-		spmembuffer_link_t * curr = *iter;
+	/* FNV-1a */
+	uint32_t hash = 2166136261u;
 
-		if( 0 == strcmp( path, curr->path ) ) {
-			ret = curr;
-			*iter = curr->next;
-			break;
-		} else {
-			iter = &( curr->next );
-		}
+	for( ; '\0' != *path; path++ ) {
+		hash ^= (unsigned char)*path;
+		hash *= 16777619u;
 	}
 
-	return ret;
+	return hash;
 }
 
 void spmembuffer_link_free( spmembuffer_link_t * iter )
 {
 	free( iter->path );
-	free( iter->mem->data );
-	free( iter->mem );
+	spmembuffer_free( iter->mem );
 	free( iter );
 }
 
 //===========================================================================
 
+/* Buffers waiting to be picked up by xOpen. A buffer only stays here
+ * between spmemvfs_open_db() and the matching xOpen, afterwards it is owned
+ * by the spmemvfs_db_t that opened it. Entries are keyed by the path plus
+ * the buffer address, so concurrent opens of the same path never pick up
+ * each other's buffer. */
 typedef struct spmemvfs_env_t {
-	spmembuffer_link_t * head;
+	spmembuffer_link_t ** buckets;
+	uint32_t nbuckets;            /* always a power of two */
+	uint32_t count;
+	int refs;                     /* spmemvfs_env_init() calls not yet finished */
 	sqlite3_mutex * mutex;
 } spmemvfs_env_t;
 
+#define SPMEMVFS_ENV_BUCKETS 16
+
 static spmemvfs_env_t * g_spmemvfs_env = NULL;
 
+static void spmemvfs_env_grow( spmemvfs_env_t * env )
+{
+	uint32_t newCount = env->nbuckets * 2;
+	spmembuffer_link_t ** newBuckets = (spmembuffer_link_t**)calloc( newCount, sizeof( spmembuffer_link_t * ) );
+	uint32_t i = 0;
+
+	/* Keep the old table if there is no memory, it is only slower. */
+	if( NULL == newBuckets ) return;
+
+	for( i = 0; i < env->nbuckets; i++ ) {
+		spmembuffer_link_t * iter = env->buckets[ i ];
+		while( NULL != iter ) {
+			spmembuffer_link_t * next = iter->next;
+			spmembuffer_link_t ** bucket = &( newBuckets[ iter->hash & ( newCount - 1 ) ] );
+
+			iter->next = *bucket;
+			*bucket = iter;
+			iter = next;
+		}
+	}
+
+	free( env->buckets );
+	env->buckets = newBuckets;
+	env->nbuckets = newCount;
+}
+
+static void spmemvfs_env_insert( spmemvfs_env_t * env, spmembuffer_link_t * link )
+{
+	spmembuffer_link_t ** bucket = NULL;
+
+	if( env->count >= env->nbuckets ) {
+		spmemvfs_env_grow( env );
+	}
+
+	bucket = &( env->buckets[ link->hash & ( env->nbuckets - 1 ) ] );
+	link->next = *bucket;
+	*bucket = link;
+	env->count++;
+}
+
+static spmembuffer_link_t * spmemvfs_env_remove( spmemvfs_env_t * env, const char * path, spmembuffer_t * mem )
+{
+	uint32_t hash = spmembuffer_hash( path );
+	spmembuffer_link_t ** iter = &( env->buckets[ hash & ( env->nbuckets - 1 ) ] );
+
+	for( ; NULL != *iter; iter = &( ( *iter )->next ) ) {
+		spmembuffer_link_t * curr = *iter;
+
+		if( curr->hash == hash && ( NULL == mem || curr->mem == mem )
+				&& 0 == strcmp( path, curr->path ) ) {
+			*iter = curr->next;
+			env->count--;
+			return curr;
+		}
+	}
+
+	return NULL;
+}
+
 static spmembuffer_t * load_cb( void * arg, const char * path )
 {
 	spmembuffer_t * ret = NULL;
@@ -433,7 +678,7 @@ static spmembuffer_t * load_cb( void * arg, const char * path )
 
 	sqlite3_mutex_enter( env->mutex );
 	{
-		spmembuffer_link_t * toFind = spmembuffer_link_remove( &( env->head ), path );
+		spmembuffer_link_t * toFind = spmemvfs_env_remove( env, path, NULL );
 
 		if( NULL != toFind ) {
 			ret = toFind->mem;
@@ -449,44 +694,89 @@ static spmembuffer_t * load_cb( void * arg, const char * path )
 int spmemvfs_env_init()
 {
 	int ret = 0;
+	sqlite3_mutex * mutex = NULL;
+
+	ret = sqlite3_initialize();
+	if( SQLITE_OK != ret ) return ret;
+
+	/* Every buffered database holds a reference, so closing one of them
+	 * leaves the VFS registered for the others. */
+	mutex = sqlite3_mutex_alloc( SQLITE_MUTEX_STATIC_APP1 );
+	sqlite3_mutex_enter( mutex );
 
 	if( NULL == g_spmemvfs_env ) {
 		spmemvfs_cb_t cb;
+		spmemvfs_env_t * env = (spmemvfs_env_t*)calloc( sizeof( spmemvfs_env_t ), 1 );
 
-		g_spmemvfs_env = (spmemvfs_env_t*)calloc( sizeof( spmemvfs_env_t ), 1 );
-		g_spmemvfs_env->mutex = sqlite3_mutex_alloc( SQLITE_MUTEX_FAST );
+		if( NULL != env ) {
+			env->nbuckets = SPMEMVFS_ENV_BUCKETS;
+			env->buckets = (spmembuffer_link_t**)calloc( env->nbuckets, sizeof( spmembuffer_link_t * ) );
+			env->mutex = sqlite3_mutex_alloc( SQLITE_MUTEX_FAST );
+		}
 
-		cb.arg = g_spmemvfs_env;
-		cb.load = load_cb;
+		if( NULL == env || NULL == env->buckets || NULL == env->mutex ) {
+			if( NULL != env ) {
+				sqlite3_mutex_free( env->mutex );
+				free( env->buckets );
+				free( env );
+			}
+			ret = SQLITE_NOMEM;
+		} else {
+			cb.arg = env;
+			cb.load = load_cb;
+
+			ret = spmemvfs_init( &cb );
+
+			if( SQLITE_OK == ret ) {
+				g_spmemvfs_env = env;
+			} else {
+				sqlite3_mutex_free( env->mutex );
+				free( env->buckets );
+				free( env );
+			}
+		}
+	}
 
-		ret = spmemvfs_init( &cb );
+	if( SQLITE_OK == ret ) {
+		g_spmemvfs_env->refs++;
 	}
 
+	sqlite3_mutex_leave( mutex );
+
 	return ret;
 }
 
 void spmemvfs_env_fini()
 {
-	if( NULL != g_spmemvfs_env ) {
-		spmembuffer_link_t * iter = NULL;
+	sqlite3_mutex * mutex = sqlite3_mutex_alloc( SQLITE_MUTEX_STATIC_APP1 );
+
+	sqlite3_mutex_enter( mutex );
+
+	if( NULL != g_spmemvfs_env && --g_spmemvfs_env->refs <= 0 ) {
+		uint32_t i = 0;
 
 		sqlite3_vfs_unregister( (sqlite3_vfs*)&g_spmemvfs );
 		g_spmemvfs.parent = NULL;
 
 		sqlite3_mutex_free( g_spmemvfs_env->mutex );
 
-		iter = g_spmemvfs_env->head;
-		for( ; NULL != iter; ) {
-			spmembuffer_link_t * next = iter->next;
+		for( i = 0; i < g_spmemvfs_env->nbuckets; i++ ) {
+			spmembuffer_link_t * iter = g_spmemvfs_env->buckets[ i ];
+			for( ; NULL != iter; ) {
+				spmembuffer_link_t * next = iter->next;
 
-			spmembuffer_link_free( iter );
+				spmembuffer_link_free( iter );
 
-			iter = next;
+				iter = next;
+			}
 		}
 
+		free( g_spmemvfs_env->buckets );
 		free( g_spmemvfs_env );
 		g_spmemvfs_env = NULL;
 	}
+
+	sqlite3_mutex_leave( mutex );
 }
 
 int spmemvfs_open_db( spmemvfs_db_t * db, const char * path, spmembuffer_t * mem )
@@ -494,34 +784,63 @@ int spmemvfs_open_db( spmemvfs_db_t * db, const char * path, spmembuffer_t * mem
 	int ret = 0;
 
 	spmembuffer_link_t * iter = NULL;
+	char * key = NULL;
+	size_t keylen = 0;
 
 	memset( db, 0, sizeof( spmemvfs_db_t ) );
 
+	if( NULL == g_spmemvfs_env ) {
+		spmembuffer_free( mem );
+		return SQLITE_MISUSE;
+	}
+
+	/* The buffer address makes the key unique while the buffer lives. */
+	keylen = strlen( path ) + 2 * sizeof( void * ) + 4;
+	key = (char*)malloc( keylen );
 	iter = (spmembuffer_link_t*)calloc( sizeof( spmembuffer_link_t ), 1 );
-	iter->path = strdup( path );
+	if( NULL != key ) snprintf( key, keylen, "%s@%p", path, (void*)mem );
+	if( NULL != key && NULL != iter ) iter->path = strdup( key );
+	if( NULL == key || NULL == iter || NULL == iter->path ) {
+		free( key );
+		free( iter );
+		spmembuffer_free( mem );
+		return SQLITE_NOMEM;
+	}
+	iter->hash = spmembuffer_hash( key );
 	iter->mem = mem;
 
 	sqlite3_mutex_enter( g_spmemvfs_env->mutex );
 	{
-		iter->next = g_spmemvfs_env->head;
-		g_spmemvfs_env->head = iter;
+		spmemvfs_env_insert( g_spmemvfs_env, iter );
 	}
 	sqlite3_mutex_leave( g_spmemvfs_env->mutex );
 
-	ret = sqlite3_open_v2( path, &(db->handle),
+	ret = sqlite3_open_v2( key, &(db->handle),
 			SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, SPMEMVFS_NAME );
 
 	if( 0 == ret ) {
 		db->mem = mem;
 	} else {
+		sqlite3_close( db->handle );
+		db->handle = NULL;
+
 		sqlite3_mutex_enter( g_spmemvfs_env->mutex );
 		{
-			iter = spmembuffer_link_remove( &(g_spmemvfs_env->head), path );
-			if( NULL != iter ) spmembuffer_link_free( iter );
+			iter = spmemvfs_env_remove( g_spmemvfs_env, key, mem );
 		}
 		sqlite3_mutex_leave( g_spmemvfs_env->mutex );
+
+		/* Either still registered or already picked up by xOpen, in both
+		 * cases the buffer is ours to release. */
+		if( NULL != iter ) {
+			spmembuffer_link_free( iter );
+		} else {
+			spmembuffer_free( mem );
+		}
 	}
 
+	free( key );
+
 	return ret;
 }
 
@@ -537,8 +856,7 @@ int spmemvfs_close_db( spmemvfs_db_t * db )
 	}
 
 	if( NULL != db->mem ) {
-		if( NULL != db->mem->data ) free( db->mem->data );
-		free( db->mem );
+		spmembuffer_free( db->mem );
 		db->mem = NULL;
 	}
 
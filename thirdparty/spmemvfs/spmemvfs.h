@@ -38,10 +38,15 @@ extern "C" {
 
 #define SPMEMVFS_NAME "spmemvfs"
 
+/* Buffers are kept as a page table of fixed size chunks, so growing a
+ * database never moves or copies pages that are already stored. */
+#define SPMEMBUFFER_CHUNK_SIZE ( 64 * 1024 )
+
 typedef struct spmembuffer_t {
-	char *data;
-	int64_t used;
-	int64_t total;
+	char **chunks;      /* NULL entries read back as zeros */
+	int64_t nchunks;    /* slots in the page table */
+	int64_t used;       /* logical file size */
+	int64_t total;      /* bytes reserved by allocated chunks */
 } spmembuffer_t;
 
 typedef struct spmemvfs_db_t {
@@ -49,10 +54,17 @@ typedef struct spmemvfs_db_t {
 	spmembuffer_t * mem;
 } spmemvfs_db_t;
 
+spmembuffer_t * spmembuffer_create( const void * data, int64_t size );
+
+void spmembuffer_free( spmembuffer_t * mem );
+
+/* Reference counted, pair every successful call with spmemvfs_env_fini(). */
 int spmemvfs_env_init();
 
 void spmemvfs_env_fini();
 
+/* Takes ownership of mem, it is released by spmemvfs_close_db() or when the
+ * open fails. */
 int spmemvfs_open_db( spmemvfs_db_t * db, const char * path, spmembuffer_t * mem );
 
 int spmemvfs_close_db( spmemvfs_db_t * db );